@@ -0,0 +1,74 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+/// Posted by the bus after it flushes; the userInfo describes everything that changed since the last flush.
+extern NSString * const RMSChangeBusDidFlushNotification;
+
+/// An NSSet of the keys that changed.
+extern NSString * const RMSChangeBusChangedKeysKey;
+
+/// An NSDictionary from each key that was changed by range to an NSIndexSet of its dirty indexes.
+extern NSString * const RMSChangeBusDirtyRangesKey;
+
+//***************************************************************************
+
+/// Collects a plugin's changes and passes them on in batches, instead of as they happen.
+/** The first change after a quiet spell is passed on as soon as it has
+  * been made, so the document shows as edited at once.  After that,
+  * changes are held until none have arrived for the debounce interval, and
+  * never for longer than the maximum latency, so a burst of a thousand
+  * keystrokes turns into a handful of flushes however fast it comes.  Each
+  * flush sends the target its action once, which is where the plugin
+  * broadcasts that it changed, and then posts
+  * RMSChangeBusDidFlushNotification with the keys and ranges that changed,
+  * so listeners can do work in proportion to the change.
+  *
+  * Dirty ranges are kept in the coordinates of the latest text: each edit
+  * shifts the ranges after it.  A deletion marks the character after it as
+  * dirty, so it isn't lost.  The bus is for use on the main thread only. */
+@interface RMSChangeBus : NSObject
+{
+	id target;
+	SEL action;
+	
+	NSTimeInterval debounceInterval;
+	NSTimeInterval maximumLatency;
+	
+	NSMutableSet *changedKeys;
+	NSMutableDictionary *dirtyRanges;
+	CFAbsoluteTime firstChangeTime;
+	CFAbsoluteTime lastFlushTime;
+}
+
+/// The target isn't retained.
+- (id)initWithTarget:(id)aTarget action:(SEL)anAction;
+
+/// Defaults to 0.3 seconds.
+@property (nonatomic, assign) NSTimeInterval debounceInterval;
+
+/// Defaults to 2 seconds.
+@property (nonatomic, assign) NSTimeInterval maximumLatency;
+
+- (void)noteChangeForKey:(NSString *)key;
+
+/// For a change to part of a key's value, like an edit to some text: the range is replaced by the given number of characters.
+- (void)noteChangeForKey:(NSString *)key replacingRange:(NSRange)range withLength:(NSUInteger)length;
+
+/// Passes on pending changes straight away, e.g. before saving.
+- (void)flush;
+
+/// Drops pending changes; must be sent before the target goes away.
+- (void)invalidate;
+
+@end
+
+//***************************************************************************
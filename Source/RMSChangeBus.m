@@ -0,0 +1,137 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+#import "RMSChangeBus.h"
+
+//***************************************************************************
+
+NSString * const RMSChangeBusDidFlushNotification = @"RMSChangeBusDidFlushNotification";
+NSString * const RMSChangeBusChangedKeysKey = @"RMSChangeBusChangedKeys";
+NSString * const RMSChangeBusDirtyRangesKey = @"RMSChangeBusDirtyRanges";
+
+//***************************************************************************
+
+@implementation RMSChangeBus
+
+@synthesize debounceInterval, maximumLatency;
+
+//***************************************************************************
+
+#pragma mark Changes
+
+/// Sent after a change has been recorded, with whether it's the first since the last flush.
+- (void)didNoteChange:(BOOL)isFirstChange
+{
+	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+	if (isFirstChange) firstChangeTime = now;
+	
+	// Every change pushes the flush back, but not past the maximum latency from the first one.
+	NSTimeInterval delay = MIN(debounceInterval, MAX(firstChangeTime + maximumLatency - now, 0.0));
+	
+	// After a quiet spell the change goes through on the next pass of the run loop, once it's been made, so the document shows as edited at once.
+	if (isFirstChange && now - lastFlushTime >= debounceInterval) delay = 0.0;
+	
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(flush) object:nil];
+	[self performSelector:@selector(flush) withObject:nil afterDelay:delay];
+}
+
+- (void)noteChangeForKey:(NSString *)key
+{
+	BOOL isFirstChange = ([changedKeys count] == 0);
+	
+	[changedKeys addObject:key];
+	[self didNoteChange:isFirstChange];
+}
+
+- (void)noteChangeForKey:(NSString *)key replacingRange:(NSRange)range withLength:(NSUInteger)length
+{
+	BOOL isFirstChange = ([changedKeys count] == 0);
+	
+	[changedKeys addObject:key];
+	
+	NSMutableIndexSet *indexes = [dirtyRanges objectForKey:key];
+	
+	if (indexes == nil)
+	{
+		indexes = [NSMutableIndexSet indexSet];
+		[dirtyRanges setObject:indexes forKey:key];
+	}
+	
+	// The replaced indexes go, those after them move, and the new ones are all dirty.
+	[indexes removeIndexesInRange:range];
+	[indexes shiftIndexesStartingAtIndex:NSMaxRange(range) by:((NSInteger)length - (NSInteger)range.length)];
+	[indexes addIndexesInRange:NSMakeRange(range.location, MAX(length, 1))];
+	
+	[self didNoteChange:isFirstChange];
+}
+
+- (void)flush
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(flush) object:nil];
+	if ([changedKeys count] == 0) return;
+	
+	NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:[[changedKeys copy] autorelease], RMSChangeBusChangedKeysKey, [[dirtyRanges copy] autorelease], RMSChangeBusDirtyRangesKey, nil];
+	
+	// Changes noted while the flush is being handled go in the next batch.
+	[changedKeys removeAllObjects];
+	[dirtyRanges removeAllObjects];
+	lastFlushTime = CFAbsoluteTimeGetCurrent();
+	
+	[target performSelector:action];
+	[[NSNotificationCenter defaultCenter] postNotificationName:RMSChangeBusDidFlushNotification object:self userInfo:userInfo];
+}
+
+- (void)invalidate
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(flush) object:nil];
+	
+	[changedKeys removeAllObjects];
+	[dirtyRanges removeAllObjects];
+	target = nil;
+}
+
+//***************************************************************************
+
+#pragma mark Object Lifecycle
+
+- (id)initWithTarget:(id)aTarget action:(SEL)anAction
+{
+	self = [super init];
+	
+	if (self)
+	{
+		target = aTarget;
+		action = anAction;
+		
+		debounceInterval = 0.3;
+		maximumLatency = 2.0;
+		
+		changedKeys = [[NSMutableSet alloc] init];
+		dirtyRanges = [[NSMutableDictionary alloc] init];
+	}
+	
+	return self;
+}
+
+- (void)dealloc
+{
+	[self invalidate];
+	
+	[changedKeys release];
+	[dirtyRanges release];
+	
+	[super dealloc];
+}
+
+@end
+
+//***************************************************************************
@@ -0,0 +1,69 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+#import "RMSHTMLLexer.h"
+#import "RMSSPSCQueue.h"
+
+//***************************************************************************
+
+typedef enum
+{
+	/// location is the line's index, length its first character, value the state it starts in.
+	RMSHTMLLexerRecordLine,
+	
+	/// location and length are the token's range, value its RMSHTMLTokenType.
+	RMSHTMLLexerRecordToken,
+	
+	/// Lexing has stopped, usually at the end of the snapshot but not always; nothing follows.
+	RMSHTMLLexerRecordFinished
+}
+RMSHTMLLexerRecordKind;
+
+typedef struct
+{
+	NSUInteger location;
+	NSUInteger length;
+	uint16_t kind;
+	uint16_t value;
+}
+RMSHTMLLexerRecord;
+
+//***************************************************************************
+
+/// Lexes an immutable snapshot of a document on a background thread.
+/** Every line's starting state and every token are published, in document
+  * order, through a lock-free single-producer/single-consumer queue, and
+  * the thread that started the lexer pops them off and applies them at its
+  * own pace.  When the queue is full the lexer backs off rather than
+  * allocating, so a slow consumer costs memory for at most the queue's
+  * capacity. */
+@interface RMSHTMLBackgroundLexer : NSObject
+{
+	NSString *string;
+	RMSSPSCQueue *queue;
+	volatile int32_t cancelled;
+}
+
+- (id)initWithString:(NSString *)aString;
+
+/// Starts lexing on a new thread.
+- (void)start;
+
+/// Stops the lexer at the next line; records already published can still be popped.
+- (void)cancel;
+
+/// Consumer side only; returns NO if the lexer hasn't published anything new yet.
+- (BOOL)popRecord:(RMSHTMLLexerRecord *)record;
+
+@end
+
+//***************************************************************************
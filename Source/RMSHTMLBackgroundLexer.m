@@ -0,0 +1,190 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+#include <libkern/OSAtomic.h>
+#include <unistd.h>
+
+#import "RMSHTMLBackgroundLexer.h"
+#import "RMSLineIndex.h"
+
+//***************************************************************************
+
+// A few screens' worth of tokens, at a couple of dozen bytes each.
+static const uint32_t kRMSBackgroundLexerQueueCapacity = 16384;
+
+static const NSUInteger kRMSBackgroundLexerChunkLength = 65536;
+static const useconds_t kRMSBackgroundLexerBackOffInterval = 1000;
+
+typedef struct
+{
+	RMSSPSCQueue *queue;
+	volatile int32_t *cancelled;
+}
+RMSBackgroundLexerContext;
+
+/// Waits for room in the queue, and returns NO if the lexer was cancelled instead.
+static BOOL RMSBackgroundLexerPublish(RMSBackgroundLexerContext *context, RMSHTMLLexerRecord record)
+{
+	while (RMSSPSCQueuePush(context->queue, &record) == NO)
+	{
+		if (*context->cancelled) return NO;
+		usleep(kRMSBackgroundLexerBackOffInterval);
+	}
+	
+	return YES;
+}
+
+static void RMSBackgroundLexerPublishToken(RMSHTMLToken token, void *context)
+{
+	RMSHTMLLexerRecord record = { token.location, token.length, RMSHTMLLexerRecordToken, token.type };
+	
+	RMSBackgroundLexerPublish(context, record);
+}
+
+//***************************************************************************
+
+@implementation RMSHTMLBackgroundLexer
+
+//***************************************************************************
+
+#pragma mark Lexing
+
+- (void)lex
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	
+	RMSBackgroundLexerContext context = { queue, &cancelled };
+	
+	NSUInteger length = [string length];
+	NSUInteger bufferCapacity = kRMSBackgroundLexerChunkLength;
+	unichar *buffer = malloc(bufferCapacity * sizeof(unichar));
+	
+	// The buffer holds the characters from bufferLocation on; lines are lexed straight out of it and it's only compacted to read more.
+	NSUInteger bufferLocation = 0;
+	NSUInteger bufferLength = 0;
+	NSUInteger lineBegin = 0;
+	NSUInteger scanIndex = 0;
+	
+	NSUInteger line = 0;
+	RMSHTMLLexerState state = RMSHTMLLexerInitialState;
+	
+	while (buffer && cancelled == 0)
+	{
+		BOOL atEnd = (bufferLocation + bufferLength == length);
+		
+		// A carriage return at the end of the buffer might be the first half of a CRLF, so it waits until the character after it has been read.
+		NSUInteger scanEnd = (atEnd == NO && bufferLength > 0 && buffer[bufferLength - 1] == '\r') ? bufferLength - 1 : bufferLength;
+		NSUInteger lineEnd = scanIndex;
+		
+		while (lineEnd < scanEnd && RMSLineIndexEndsLine(buffer[lineEnd], (lineEnd + 1 < bufferLength) ? buffer[lineEnd + 1] : 0) == NO) lineEnd++;
+		
+		if (lineEnd < scanEnd || atEnd)
+		{
+			// Lines include their line break, and the line after a trailing line break is an empty one, as in the highlighter's index.
+			NSUInteger lineLength = ((lineEnd < bufferLength) ? lineEnd + 1 : bufferLength) - lineBegin;
+			RMSHTMLLexerRecord lineRecord = { line, bufferLocation + lineBegin, RMSHTMLLexerRecordLine, state };
+			
+			if (RMSBackgroundLexerPublish(&context, lineRecord) == NO) break;
+			state = RMSHTMLLexLine(buffer + lineBegin, lineLength, bufferLocation + lineBegin, state, RMSBackgroundLexerPublishToken, &context);
+			
+			if (lineEnd == bufferLength) break;
+			
+			lineBegin = scanIndex = lineEnd + 1;
+			line++;
+			
+			continue;
+		}
+		
+		// The line goes past the end of the buffer: move it to the front and read some more of it.
+		scanIndex = lineEnd - lineBegin;
+		memmove(buffer, buffer + lineBegin, (bufferLength - lineBegin) * sizeof(unichar));
+		bufferLocation += lineBegin;
+		bufferLength -= lineBegin;
+		lineBegin = 0;
+		
+		if (bufferCapacity - bufferLength < kRMSBackgroundLexerChunkLength)
+		{
+			bufferCapacity = MAX(bufferCapacity * 2, bufferLength + kRMSBackgroundLexerChunkLength);
+			buffer = reallocf(buffer, bufferCapacity * sizeof(unichar));
+			if (buffer == NULL) break;
+		}
+		
+		NSUInteger readLength = MIN(kRMSBackgroundLexerChunkLength, length - (bufferLocation + bufferLength));
+		[string getCharacters:(buffer + bufferLength) range:NSMakeRange(bufferLocation + bufferLength, readLength)];
+		
+		bufferLength += readLength;
+	}
+	
+	// Sent however lexing stopped, even when memory ran out part way through, so the highlighter stops waiting and catches up on whatever's left itself.
+	RMSHTMLLexerRecord finishedRecord = { 0, 0, RMSHTMLLexerRecordFinished, 0 };
+	RMSBackgroundLexerPublish(&context, finishedRecord);
+	
+	free(buffer);
+	[pool drain];
+}
+
+//***************************************************************************
+
+#pragma mark Producing and Consuming
+
+- (void)start
+{
+	[NSThread detachNewThreadSelector:@selector(lex) toTarget:self withObject:nil];
+}
+
+- (void)cancel
+{
+	OSAtomicCompareAndSwap32Barrier(0, 1, &cancelled);
+}
+
+- (BOOL)popRecord:(RMSHTMLLexerRecord *)record
+{
+	return RMSSPSCQueuePop(queue, record);
+}
+
+//***************************************************************************
+
+#pragma mark Object Lifecycle
+
+- (id)initWithString:(NSString *)aString
+{
+	self = [super init];
+	
+	if (self)
+	{
+		queue = RMSSPSCQueueCreate(kRMSBackgroundLexerQueueCapacity, sizeof(RMSHTMLLexerRecord));
+		
+		if (queue == NULL)
+		{
+			[self release];
+			return nil;
+		}
+		
+		// A copy of a mutable string is an immutable snapshot; an immutable one is just retained.
+		string = [aString copy];
+	}
+	
+	return self;
+}
+
+- (void)dealloc
+{
+	// The lexing thread retains the lexer, so by now nothing can be pushing.
+	RMSSPSCQueueDestroy(queue);
+	[string release];
+	
+	[super dealloc];
+}
+
+@end
+
+//***************************************************************************
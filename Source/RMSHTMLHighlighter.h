@@ -0,0 +1,70 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+@class RMSHTMLBackgroundLexer;
+@class RMSLineIndex;
+
+//***************************************************************************
+
+/// Incremental syntax colouring for an RWHTMLView, or any other NSTextView, as a replacement for -colorize.
+/** The lexer state at the start of every line is kept as a checkpoint.  After
+  * an edit, lexing restarts at the edited line and stops as soon as it
+  * reaches a line past the edit whose checkpoint hasn't changed, so typing
+  * usually re-lexes a single line however long the document is.  Lines a
+  * long way below the edit, which only need lexing when something like an
+  * unterminated comment changes their state, are caught up in short slices
+  * from the run loop.
+  *
+  * Colours are applied as layout manager temporary attributes, and only to
+  * the visible text plus a margin; scrolling colours whatever comes into
+  * view.  The text storage itself is never touched, so colouring doesn't
+  * dirty the document or the undo stack.
+  *
+  * -highlightAll colours the visible text straight away and hands the rest
+  * of the document to a background lexer working on a snapshot of it, so a
+  * large page opens instantly and colours in progressively.  The first edit
+  * makes the snapshot stale, so the background lexer is stopped there and
+  * the main thread catches up on whatever it hadn't reached. */
+@interface RMSHTMLHighlighter : NSObject
+{
+	NSTextView *textView;
+	
+	RMSLineIndex *lineIndex;
+	NSMutableData *lineStates;
+	NSUInteger validLineCount;
+	
+	NSRange pendingColorRange;
+	BOOL applyScheduled;
+	BOOL catchUpScheduled;
+	
+	RMSHTMLBackgroundLexer *backgroundLexer;
+	
+	unichar *lineBuffer;
+	NSUInteger lineBufferCapacity;
+	
+	NSArray *tokenAttributes;
+}
+
+- (id)initWithTextView:(NSTextView *)aTextView;
+
+/// Kept up to date with every edit, so views like a line number gutter can share it instead of keeping their own.
+@property (readonly) RMSLineIndex *lineIndex;
+
+/// Re-indexes the whole document, e.g. after -setString:; edits after that are picked up automatically.
+- (void)highlightAll;
+
+/// Stops observing the text view; must be sent before the text view goes away.
+- (void)invalidate;
+
+@end
+
+//***************************************************************************
@@ -0,0 +1,480 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+#import "RMSHTMLHighlighter.h"
+#import "RMSHTMLLexer.h"
+#import "RMSHTMLBackgroundLexer.h"
+#import "RMSLineIndex.h"
+
+//***************************************************************************
+
+// Far more lines than fit on screen, but few enough to lex well inside a frame.
+static const NSUInteger kRMSHighlighterSynchronousLineLimit = 500;
+
+static const NSUInteger kRMSHighlighterVisibleMargin = 4096;
+static const CFTimeInterval kRMSHighlighterCatchUpSliceDuration = 0.005;
+static const CFTimeInterval kRMSHighlighterDrainSliceDuration = 0.004;
+static const NSTimeInterval kRMSHighlighterDrainIdleInterval = 0.02;
+
+typedef struct
+{
+	NSLayoutManager *layoutManager;
+	NSArray *tokenAttributes;
+}
+RMSHighlighterColorContext;
+
+static void RMSHighlighterIgnoreToken(RMSHTMLToken token, void *context)
+{
+}
+
+static void RMSHighlighterColorToken(RMSHTMLToken token, void *context)
+{
+	RMSHighlighterColorContext *colorContext = context;
+	
+	[colorContext->layoutManager addTemporaryAttributes:[colorContext->tokenAttributes objectAtIndex:token.type] forCharacterRange:NSMakeRange(token.location, token.length)];
+}
+
+/// Maps a range in the text from before an edit to the text after it, growing it to cover the edit if they overlap.
+static NSRange RMSRangeAdjustedForEdit(NSRange range, NSRange editedRange, NSInteger changeInLength)
+{
+	if (range.location == NSNotFound) return range;
+	
+	NSUInteger oldEditEnd = NSMaxRange(editedRange) - changeInLength;
+	
+	if (range.location >= oldEditEnd)
+	{
+		range.location += changeInLength;
+		return range;
+	}
+	
+	if (NSMaxRange(range) <= editedRange.location) return range;
+	
+	NSUInteger start = MIN(range.location, editedRange.location);
+	NSUInteger end = (NSUInteger)MAX((NSInteger)NSMaxRange(range) + changeInLength, (NSInteger)NSMaxRange(editedRange));
+	
+	return NSMakeRange(start, end - start);
+}
+
+static NSArray *RMSHighlighterTokenAttributes()
+{
+	NSColor *colors[RMSHTMLTokenTypeCount];
+	
+	colors[RMSHTMLTokenTag] = [NSColor colorWithCalibratedRed:0.00 green:0.20 blue:0.60 alpha:1.0];
+	colors[RMSHTMLTokenAttributeName] = [NSColor colorWithCalibratedRed:0.40 green:0.30 blue:0.00 alpha:1.0];
+	colors[RMSHTMLTokenAttributeValue] = [NSColor colorWithCalibratedRed:0.77 green:0.10 blue:0.09 alpha:1.0];
+	colors[RMSHTMLTokenComment] = [NSColor colorWithCalibratedRed:0.00 green:0.45 blue:0.00 alpha:1.0];
+	colors[RMSHTMLTokenEntity] = [NSColor colorWithCalibratedRed:0.60 green:0.40 blue:0.00 alpha:1.0];
+	colors[RMSHTMLTokenKeyword] = [NSColor colorWithCalibratedRed:0.67 green:0.05 blue:0.57 alpha:1.0];
+	colors[RMSHTMLTokenString] = [NSColor colorWithCalibratedRed:0.77 green:0.10 blue:0.09 alpha:1.0];
+	
+	NSMutableArray *attributes = [NSMutableArray arrayWithCapacity:RMSHTMLTokenTypeCount];
+	
+	for (NSUInteger tokenType = 0; tokenType < RMSHTMLTokenTypeCount; tokenType++)
+	{
+		[attributes addObject:[NSDictionary dictionaryWithObject:colors[tokenType] forKey:NSForegroundColorAttributeName]];
+	}
+	
+	return attributes;
+}
+
+//***************************************************************************
+
+@implementation RMSHTMLHighlighter
+
+//***************************************************************************
+
+#pragma mark Line Index
+
+@synthesize lineIndex;
+
+- (NSUInteger)lineCount
+{
+	return [lineIndex lineCount];
+}
+
+/// Brings the line index up to date with an edit, and returns the first line it touched.
+- (NSUInteger)updateLinesForEditedRange:(NSRange)editedRange changeInLength:(NSInteger)changeInLength string:(NSString *)string
+{
+	NSUInteger replacementLineCount;
+	NSRange replacedLines = [lineIndex updateForEditedRange:editedRange changeInLength:changeInLength string:string replacementLineCount:&replacementLineCount];
+	
+	// The first line is replaced by itself; only the checkpoints of the others come and go.
+	NSUInteger firstLine = replacedLines.location;
+	NSUInteger firstMovedLine = NSMaxRange(replacedLines);
+	NSUInteger removedCount = replacedLines.length - 1;
+	NSUInteger insertedCount = replacementLineCount - 1;
+	
+	[lineStates replaceBytesInRange:NSMakeRange((firstLine + 1) * sizeof(RMSHTMLLexerState), removedCount * sizeof(RMSHTMLLexerState)) withBytes:[[NSMutableData dataWithLength:insertedCount * sizeof(RMSHTMLLexerState)] bytes] length:insertedCount * sizeof(RMSHTMLLexerState)];
+	
+	// Checkpoints after the edit are kept: they're what tells re-lexing that it has converged.
+	if (validLineCount > firstLine + 1)
+	{
+		if (validLineCount >= firstMovedLine) validLineCount = validLineCount - removedCount + insertedCount;
+		else validLineCount = firstLine + 1;
+	}
+	
+	return firstLine;
+}
+
+//***************************************************************************
+
+#pragma mark Lexing
+
+- (RMSHTMLLexerState)lexLine:(NSUInteger)line string:(NSString *)string tokenFunction:(RMSHTMLLexerTokenFunction)tokenFunction context:(void *)context
+{
+	NSRange lineRange = [lineIndex rangeOfLine:line];
+	
+	if (lineRange.length > lineBufferCapacity)
+	{
+		lineBufferCapacity = MAX(lineRange.length, lineBufferCapacity * 2);
+		lineBuffer = reallocf(lineBuffer, lineBufferCapacity * sizeof(unichar));
+	}
+	
+	[string getCharacters:lineBuffer range:lineRange];
+	
+	const RMSHTMLLexerState *states = [lineStates bytes];
+	
+	return RMSHTMLLexLine(lineBuffer, lineRange.length, lineRange.location, states[line], tokenFunction, context);
+}
+
+- (void)ensureValidThroughLine:(NSUInteger)line string:(NSString *)string
+{
+	RMSHTMLLexerState *states = [lineStates mutableBytes];
+	
+	while (validLineCount <= line)
+	{
+		states[validLineCount] = [self lexLine:(validLineCount - 1) string:string tokenFunction:RMSHighlighterIgnoreToken context:NULL];
+		validLineCount++;
+	}
+}
+
+- (void)scheduleCatchUp
+{
+	if (catchUpScheduled) return;
+	
+	catchUpScheduled = YES;
+	[self performSelector:@selector(catchUp) withObject:nil afterDelay:0.0];
+}
+
+- (void)catchUp
+{
+	catchUpScheduled = NO;
+	
+	// The background lexer is already doing this, off the main thread.
+	if (backgroundLexer) return;
+	
+	NSString *string = [[textView textStorage] string];
+	NSUInteger lineCount = [self lineCount];
+	CFAbsoluteTime deadline = CFAbsoluteTimeGetCurrent() + kRMSHighlighterCatchUpSliceDuration;
+	
+	while (validLineCount < lineCount)
+	{
+		[self ensureValidThroughLine:MIN(validLineCount + 63, lineCount - 1) string:string];
+		if (CFAbsoluteTimeGetCurrent() > deadline) break;
+	}
+	
+	if (validLineCount < lineCount) [self scheduleCatchUp];
+}
+
+//***************************************************************************
+
+#pragma mark Background Lexing
+
+- (void)startBackgroundLexing
+{
+	backgroundLexer = [[RMSHTMLBackgroundLexer alloc] initWithString:[[textView textStorage] string]];
+	
+	if (backgroundLexer == nil)
+	{
+		[self scheduleCatchUp];
+		return;
+	}
+	
+	[backgroundLexer start];
+	[self performSelector:@selector(drainBackgroundLexer) withObject:nil afterDelay:0.0];
+}
+
+- (void)stopBackgroundLexing
+{
+	if (backgroundLexer == nil) return;
+	
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(drainBackgroundLexer) object:nil];
+	
+	[backgroundLexer cancel];
+	[backgroundLexer release];
+	backgroundLexer = nil;
+}
+
+/// Applies what the background lexer has published so far, for no longer than a slice.
+- (void)drainBackgroundLexer
+{
+	NSLayoutManager *layoutManager = [textView layoutManager];
+	CFAbsoluteTime deadline = CFAbsoluteTimeGetCurrent() + kRMSHighlighterDrainSliceDuration;
+	
+	NSUInteger lineCount = [self lineCount];
+	RMSHTMLLexerState *states = [lineStates mutableBytes];
+	
+	RMSHTMLLexerRecord record;
+	NSUInteger recordCount = 0;
+	
+	while ([backgroundLexer popRecord:&record])
+	{
+		if (record.kind == RMSHTMLLexerRecordToken)
+		{
+			[layoutManager addTemporaryAttributes:[tokenAttributes objectAtIndex:record.value] forCharacterRange:NSMakeRange(record.location, record.length)];
+		}
+		else if (record.kind == RMSHTMLLexerRecordLine)
+		{
+			// Colouring the visible text may already have lexed this far on the main thread.
+			if (record.location == validLineCount && record.location < lineCount && [lineIndex rangeOfLine:record.location].location == record.length)
+			{
+				states[validLineCount++] = record.value;
+			}
+		}
+		else
+		{
+			[self stopBackgroundLexing];
+			if (validLineCount < lineCount) [self scheduleCatchUp];
+			return;
+		}
+		
+		// Checking the clock is cheap, but not so cheap it's worth doing for every token.
+		if ((++recordCount & 63) == 0 && CFAbsoluteTimeGetCurrent() > deadline) break;
+	}
+	
+	// An empty queue means the lexer's behind, so give it time to get ahead rather than spinning the run loop.
+	NSTimeInterval delay = (recordCount == 0) ? kRMSHighlighterDrainIdleInterval : 0.0;
+	[self performSelector:@selector(drainBackgroundLexer) withObject:nil afterDelay:delay];
+}
+
+//***************************************************************************
+
+#pragma mark Colouring
+
+- (NSRange)visibleCharacterRange
+{
+	NSLayoutManager *layoutManager = [textView layoutManager];
+	NSRange glyphRange = [layoutManager glyphRangeForBoundingRectWithoutAdditionalLayout:[textView visibleRect] inTextContainer:[textView textContainer]];
+	NSRange characterRange = [layoutManager characterRangeForGlyphRange:glyphRange actualGlyphRange:NULL];
+	
+	NSUInteger textLength = [[textView textStorage] length];
+	NSUInteger start = (characterRange.location > kRMSHighlighterVisibleMargin) ? characterRange.location - kRMSHighlighterVisibleMargin : 0;
+	NSUInteger end = MIN(NSMaxRange(characterRange) + kRMSHighlighterVisibleMargin, textLength);
+	
+	return NSMakeRange(start, (end > start) ? end - start : 0);
+}
+
+- (void)colorCharacterRange:(NSRange)range
+{
+	NSString *string = [[textView textStorage] string];
+	
+	range = NSIntersectionRange(range, NSMakeRange(0, [string length]));
+	if (range.length == 0) return;
+	
+	NSUInteger firstLine = [lineIndex lineForCharacterIndex:range.location];
+	NSUInteger lastLine = [lineIndex lineForCharacterIndex:NSMaxRange(range) - 1];
+	
+	[self ensureValidThroughLine:lastLine string:string];
+	
+	NSRange firstLineRange = [lineIndex rangeOfLine:firstLine];
+	NSRange linesRange = NSUnionRange(firstLineRange, [lineIndex rangeOfLine:lastLine]);
+	
+	NSLayoutManager *layoutManager = [textView layoutManager];
+	[layoutManager removeTemporaryAttribute:NSForegroundColorAttributeName forCharacterRange:linesRange];
+	
+	RMSHighlighterColorContext context = { layoutManager, tokenAttributes };
+	
+	for (NSUInteger line = firstLine; line <= lastLine; line++)
+	{
+		[self lexLine:line string:string tokenFunction:RMSHighlighterColorToken context:&context];
+	}
+}
+
+- (void)scheduleApply
+{
+	if (applyScheduled) return;
+	
+	applyScheduled = YES;
+	[self performSelector:@selector(applyPendingColors) withObject:nil afterDelay:0.0];
+}
+
+- (void)applyPendingColors
+{
+	applyScheduled = NO;
+	
+	if (pendingColorRange.location == NSNotFound) return;
+	
+	// Text that's off screen is coloured when it's scrolled into view instead.
+	NSRange range = NSIntersectionRange(pendingColorRange, [self visibleCharacterRange]);
+	pendingColorRange = NSMakeRange(NSNotFound, 0);
+	
+	[self colorCharacterRange:range];
+}
+
+- (void)addPendingColorRange:(NSRange)range
+{
+	if (pendingColorRange.location == NSNotFound) pendingColorRange = range;
+	else pendingColorRange = NSUnionRange(pendingColorRange, range);
+	
+	[self scheduleApply];
+}
+
+//***************************************************************************
+
+#pragma mark Notifications
+
+- (void)textStorageDidProcessEditing:(NSNotification *)notification
+{
+	NSTextStorage *textStorage = [notification object];
+	if (([textStorage editedMask] & NSTextStorageEditedCharacters) == 0) return;
+	
+	// The background lexer's snapshot is out of date now, so whatever it hasn't covered is caught up here instead.
+	if (backgroundLexer)
+	{
+		[self stopBackgroundLexing];
+		[self scheduleCatchUp];
+	}
+	
+	NSString *string = [textStorage string];
+	NSRange editedRange = [textStorage editedRange];
+	NSInteger changeInLength = [textStorage changeInLength];
+	
+	NSUInteger firstLine = [self updateLinesForEditedRange:editedRange changeInLength:changeInLength string:string];
+	pendingColorRange = RMSRangeAdjustedForEdit(pendingColorRange, editedRange, changeInLength);
+	
+	NSUInteger lineCount = [self lineCount];
+	NSUInteger line = firstLine;
+	
+	if (firstLine < validLineCount)
+	{
+		NSUInteger lastEditedLine = [lineIndex lineForCharacterIndex:NSMaxRange(editedRange)];
+		NSUInteger lastSynchronousLine = MIN(lastEditedLine + kRMSHighlighterSynchronousLineLimit, lineCount - 1);
+		BOOL converged = NO;
+		
+		while (line < lastSynchronousLine)
+		{
+			RMSHTMLLexerState nextState = [self lexLine:line string:string tokenFunction:RMSHighlighterIgnoreToken context:NULL];
+			RMSHTMLLexerState *states = [lineStates mutableBytes];
+			
+			line++;
+			
+			converged = (line > lastEditedLine && line < validLineCount && states[line] == nextState);
+			states[line] = nextState;
+			
+			if (converged) break;
+		}
+		
+		if (converged == NO)
+		{
+			validLineCount = line + 1;
+			if (validLineCount < lineCount) [self scheduleCatchUp];
+		}
+	}
+	
+	// The layout manager hears about the edit after this notification, so colouring has to wait until it has.
+	NSRange firstLineRange = [lineIndex rangeOfLine:firstLine];
+	[self addPendingColorRange:NSUnionRange(firstLineRange, [lineIndex rangeOfLine:line])];
+}
+
+- (void)visibleRectDidChange:(NSNotification *)notification
+{
+	[self addPendingColorRange:[self visibleCharacterRange]];
+}
+
+//***************************************************************************
+
+#pragma mark Highlighting
+
+- (void)highlightAll
+{
+	[self stopBackgroundLexing];
+	
+	NSString *string = [[textView textStorage] string];
+	
+	RMSHTMLLexerState initialState = RMSHTMLLexerInitialState;
+	
+	[lineIndex resetWithString:string];
+	
+	[lineStates setLength:[self lineCount] * sizeof(RMSHTMLLexerState)];
+	*(RMSHTMLLexerState *)[lineStates mutableBytes] = initialState;
+	validLineCount = 1;
+	
+	[[textView layoutManager] removeTemporaryAttribute:NSForegroundColorAttributeName forCharacterRange:NSMakeRange(0, [string length])];
+	
+	pendingColorRange = NSMakeRange(NSNotFound, 0);
+	[self colorCharacterRange:[self visibleCharacterRange]];
+	
+	// Everything else is lexed in the background and coloured in as it arrives.
+	[self startBackgroundLexing];
+}
+
+//***************************************************************************
+
+#pragma mark Object Lifecycle
+
+- (id)initWithTextView:(NSTextView *)aTextView
+{
+	self = [super init];
+	
+	if (self)
+	{
+		textView = aTextView;
+		
+		lineIndex = [[RMSLineIndex alloc] init];
+		lineStates = [[NSMutableData alloc] init];
+		pendingColorRange = NSMakeRange(NSNotFound, 0);
+		tokenAttributes = [RMSHighlighterTokenAttributes() retain];
+		
+		NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+		[center addObserver:self selector:@selector(textStorageDidProcessEditing:) name:NSTextStorageDidProcessEditingNotification object:[textView textStorage]];
+		[center addObserver:self selector:@selector(visibleRectDidChange:) name:NSViewFrameDidChangeNotification object:textView];
+		
+		NSClipView *clipView = [[textView enclosingScrollView] contentView];
+		
+		if (clipView)
+		{
+			[clipView setPostsBoundsChangedNotifications:YES];
+			[center addObserver:self selector:@selector(visibleRectDidChange:) name:NSViewBoundsDidChangeNotification object:clipView];
+		}
+		
+		[self highlightAll];
+	}
+	
+	return self;
+}
+
+- (void)invalidate
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	[NSObject cancelPreviousPerformRequestsWithTarget:self];
+	[self stopBackgroundLexing];
+	
+	applyScheduled = NO;
+	catchUpScheduled = NO;
+	textView = nil;
+}
+
+- (void)dealloc
+{
+	[self invalidate];
+	
+	[lineIndex release];
+	[lineStates release];
+	[tokenAttributes release];
+	free(lineBuffer);
+	
+	[super dealloc];
+}
+
+@end
+
+//***************************************************************************
@@ -0,0 +1,56 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+// A line-at-a-time lexer for HTML with embedded CSS and JavaScript, for
+// syntax colouring.  All the state that carries from one line to the next
+// (an unterminated comment, a tag that's still open, being inside a
+// <script> element, ...) fits in an RMSHTMLLexerState, so a highlighter can
+// keep one per line as a checkpoint and restart lexing from any line.  It's
+// forgiving rather than correct: it only needs to colour what people type.
+
+//***************************************************************************
+
+typedef uint16_t RMSHTMLLexerState;
+
+extern const RMSHTMLLexerState RMSHTMLLexerInitialState;
+
+typedef enum
+{
+	RMSHTMLTokenTag,
+	RMSHTMLTokenAttributeName,
+	RMSHTMLTokenAttributeValue,
+	RMSHTMLTokenComment,
+	RMSHTMLTokenEntity,
+	RMSHTMLTokenKeyword,
+	RMSHTMLTokenString,
+	
+	RMSHTMLTokenTypeCount
+}
+RMSHTMLTokenType;
+
+typedef struct
+{
+	NSUInteger location;
+	NSUInteger length;
+	RMSHTMLTokenType type;
+}
+RMSHTMLToken;
+
+/// Called for every token; plain text between tokens isn't reported.
+typedef void (*RMSHTMLLexerTokenFunction)(RMSHTMLToken token, void *context);
+
+/// Lexes one line, which should include its line terminator, and returns the state the next line starts in.
+/** Token locations are offset by lineLocation, so they can be reported in
+  * document coordinates. */
+RMSHTMLLexerState RMSHTMLLexLine(const unichar *characters, NSUInteger length, NSUInteger lineLocation, RMSHTMLLexerState state, RMSHTMLLexerTokenFunction tokenFunction, void *context);
+
+//***************************************************************************
@@ -0,0 +1,394 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+#include <stdlib.h>
+#include <string.h>
+
+#import "RMSHTMLLexer.h"
+
+//***************************************************************************
+
+enum
+{
+	kRMSLexerModeText,
+	kRMSLexerModeTag,
+	kRMSLexerModeTagDoubleQuote,
+	kRMSLexerModeTagSingleQuote,
+	kRMSLexerModeComment,
+	kRMSLexerModeScript,
+	kRMSLexerModeScriptComment,
+	kRMSLexerModeStyle,
+	kRMSLexerModeStyleComment,
+};
+
+/// Which element's content follows the tag that's currently open.
+enum
+{
+	kRMSLexerTagContextNone,
+	kRMSLexerTagContextScript,
+	kRMSLexerTagContextStyle,
+};
+
+const RMSHTMLLexerState RMSHTMLLexerInitialState = 0;
+
+static inline RMSHTMLLexerState RMSLexerMakeState(NSUInteger mode, NSUInteger tagContext)
+{
+	return (RMSHTMLLexerState)(mode | (tagContext << 4));
+}
+
+//***************************************************************************
+
+// Sorted, for bsearch().
+static const char * const kRMSJavaScriptKeywords[] =
+{
+	"break", "case", "catch", "continue", "default", "delete", "do", "else",
+	"false", "finally", "for", "function", "if", "in", "instanceof", "new",
+	"null", "return", "switch", "this", "throw", "true", "try", "typeof",
+	"undefined", "var", "void", "while", "with",
+};
+
+static const NSUInteger kRMSLongestJavaScriptKeywordLength = 10;
+
+//***************************************************************************
+
+static inline BOOL RMSIsASCIILetter(unichar c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline BOOL RMSIsASCIIDigit(unichar c)
+{
+	return (c >= '0' && c <= '9');
+}
+
+static inline BOOL RMSIsNameCharacter(unichar c)
+{
+	return RMSIsASCIILetter(c) || RMSIsASCIIDigit(c) || c == '-' || c == ':' || c == '_' || c == '.';
+}
+
+static inline BOOL RMSIsIdentifierCharacter(unichar c)
+{
+	return RMSIsASCIILetter(c) || RMSIsASCIIDigit(c) || c == '_' || c == '$';
+}
+
+static inline unichar RMSLowercaseASCII(unichar c)
+{
+	return (c >= 'A' && c <= 'Z') ? (unichar)(c + ('a' - 'A')) : c;
+}
+
+/// Whether the characters at index start with the given lowercase ASCII string, ignoring case.
+static BOOL RMSHasPrefix(const unichar *characters, NSUInteger length, NSUInteger index, const char *prefix)
+{
+	for (; *prefix; prefix++, index++)
+	{
+		if (index >= length || RMSLowercaseASCII(characters[index]) != (unichar)*prefix) return NO;
+	}
+	
+	return YES;
+}
+
+static BOOL RMSIsWord(const unichar *characters, NSUInteger start, NSUInteger end, const char *word)
+{
+	return (end - start == strlen(word)) && RMSHasPrefix(characters, end, start, word);
+}
+
+static int RMSCompareKeyword(const void *key, const void *element)
+{
+	return strcmp((const char *)key, *(const char * const *)element);
+}
+
+static BOOL RMSIsJavaScriptKeyword(const unichar *characters, NSUInteger start, NSUInteger end)
+{
+	if (end - start > kRMSLongestJavaScriptKeywordLength) return NO;
+	
+	char word[kRMSLongestJavaScriptKeywordLength + 1];
+	NSUInteger wordLength = 0;
+	
+	for (NSUInteger index = start; index < end; index++)
+	{
+		// Keywords are case-sensitive and all lowercase.
+		if (characters[index] < 'a' || characters[index] > 'z') return NO;
+		word[wordLength++] = (char)characters[index];
+	}
+	
+	word[wordLength] = '\0';
+	
+	return bsearch(word, kRMSJavaScriptKeywords, sizeof(kRMSJavaScriptKeywords) / sizeof(kRMSJavaScriptKeywords[0]), sizeof(kRMSJavaScriptKeywords[0]), RMSCompareKeyword) != NULL;
+}
+
+/// The index of the first character of terminator at or after index, or length if it's not on this line.
+static NSUInteger RMSFindTerminator(const unichar *characters, NSUInteger length, NSUInteger index, const char *terminator)
+{
+	for (; index < length; index++)
+	{
+		if (characters[index] == (unichar)terminator[0] && RMSHasPrefix(characters, length, index, terminator)) return index;
+	}
+	
+	return length;
+}
+
+/// The index just past a quoted string starting at index; strings never run past the end of the line.
+static NSUInteger RMSEndOfQuotedString(const unichar *characters, NSUInteger length, NSUInteger index)
+{
+	unichar quote = characters[index];
+	
+	for (index++; index < length; index++)
+	{
+		if (characters[index] == '\\') index++;
+		else if (characters[index] == quote) return index + 1;
+		else if (characters[index] == '\n' || characters[index] == '\r') return index;
+	}
+	
+	return length;
+}
+
+//***************************************************************************
+
+#define RMSEmitToken(start, end, tokenType) \
+	do { \
+		if ((end) > (start)) tokenFunction((RMSHTMLToken){ lineLocation + (start), (end) - (start), (tokenType) }, context); \
+	} while (0)
+
+RMSHTMLLexerState RMSHTMLLexLine(const unichar *characters, NSUInteger length, NSUInteger lineLocation, RMSHTMLLexerState state, RMSHTMLLexerTokenFunction tokenFunction, void *context)
+{
+	NSUInteger mode = state & 0x0F;
+	NSUInteger tagContext = (state >> 4) & 0x03;
+	
+	// Constructs carried over from the previous line start at the beginning of this one.
+	NSUInteger tokenStart = 0;
+	NSUInteger index = 0;
+	
+	while (index < length)
+	{
+		unichar c = characters[index];
+		
+		switch (mode)
+		{
+			case kRMSLexerModeText:
+			{
+				if (c == '<')
+				{
+					if (RMSHasPrefix(characters, length, index, "<!--"))
+					{
+						mode = kRMSLexerModeComment;
+						tokenStart = index;
+						index += 4;
+						continue;
+					}
+					
+					NSUInteger nameStart = index + 1;
+					BOOL closing = (nameStart < length && characters[nameStart] == '/');
+					if (closing) nameStart++;
+					
+					if (nameStart < length && (RMSIsASCIILetter(characters[nameStart]) || (closing == NO && (characters[nameStart] == '!' || characters[nameStart] == '?'))))
+					{
+						NSUInteger nameEnd = nameStart + 1;
+						while (nameEnd < length && RMSIsNameCharacter(characters[nameEnd])) nameEnd++;
+						
+						RMSEmitToken(index, nameEnd, RMSHTMLTokenTag);
+						
+						tagContext = kRMSLexerTagContextNone;
+						
+						if (closing == NO)
+						{
+							if (RMSIsWord(characters, nameStart, nameEnd, "script")) tagContext = kRMSLexerTagContextScript;
+							else if (RMSIsWord(characters, nameStart, nameEnd, "style")) tagContext = kRMSLexerTagContextStyle;
+						}
+						
+						mode = kRMSLexerModeTag;
+						index = nameEnd;
+						continue;
+					}
+				}
+				else if (c == '&')
+				{
+					NSUInteger end = index + 1;
+					if (end < length && characters[end] == '#') end++;
+					while (end < length && end - index < 32 && RMSIsNameCharacter(characters[end])) end++;
+					
+					if (end < length && characters[end] == ';' && end > index + 1)
+					{
+						RMSEmitToken(index, end + 1, RMSHTMLTokenEntity);
+						index = end + 1;
+						continue;
+					}
+				}
+				
+				index++;
+				break;
+			}
+			
+			case kRMSLexerModeTag:
+			{
+				if (c == '>' || (c == '/' && index + 1 < length && characters[index + 1] == '>'))
+				{
+					NSUInteger end = index + ((c == '>') ? 1 : 2);
+					RMSEmitToken(index, end, RMSHTMLTokenTag);
+					
+					if (c == '>' && tagContext == kRMSLexerTagContextScript) mode = kRMSLexerModeScript;
+					else if (c == '>' && tagContext == kRMSLexerTagContextStyle) mode = kRMSLexerModeStyle;
+					else mode = kRMSLexerModeText;
+					
+					tagContext = kRMSLexerTagContextNone;
+					index = end;
+					continue;
+				}
+				
+				if (c == '"' || c == '\'')
+				{
+					mode = (c == '"') ? kRMSLexerModeTagDoubleQuote : kRMSLexerModeTagSingleQuote;
+					tokenStart = index;
+					index++;
+					continue;
+				}
+				
+				if (RMSIsNameCharacter(c))
+				{
+					NSUInteger end = index + 1;
+					while (end < length && RMSIsNameCharacter(characters[end])) end++;
+					
+					RMSEmitToken(index, end, RMSHTMLTokenAttributeName);
+					index = end;
+					continue;
+				}
+				
+				index++;
+				break;
+			}
+			
+			case kRMSLexerModeTagDoubleQuote:
+			case kRMSLexerModeTagSingleQuote:
+			{
+				unichar quote = (mode == kRMSLexerModeTagDoubleQuote) ? '"' : '\'';
+				
+				NSUInteger end = index;
+				while (end < length && characters[end] != quote) end++;
+				
+				if (end < length)
+				{
+					RMSEmitToken(tokenStart, end + 1, RMSHTMLTokenAttributeValue);
+					mode = kRMSLexerModeTag;
+					index = end + 1;
+				}
+				else
+				{
+					RMSEmitToken(tokenStart, length, RMSHTMLTokenAttributeValue);
+					index = length;
+				}
+				
+				continue;
+			}
+			
+			case kRMSLexerModeComment:
+			case kRMSLexerModeScriptComment:
+			case kRMSLexerModeStyleComment:
+			{
+				const char *terminator = (mode == kRMSLexerModeComment) ? "-->" : "*/";
+				NSUInteger end = RMSFindTerminator(characters, length, index, terminator);
+				
+				if (end < length)
+				{
+					end += strlen(terminator);
+					RMSEmitToken(tokenStart, end, RMSHTMLTokenComment);
+					
+					if (mode == kRMSLexerModeComment) mode = kRMSLexerModeText;
+					else if (mode == kRMSLexerModeScriptComment) mode = kRMSLexerModeScript;
+					else mode = kRMSLexerModeStyle;
+					
+					index = end;
+				}
+				else
+				{
+					RMSEmitToken(tokenStart, length, RMSHTMLTokenComment);
+					index = length;
+				}
+				
+				continue;
+			}
+			
+			case kRMSLexerModeScript:
+			case kRMSLexerModeStyle:
+			{
+				BOOL script = (mode == kRMSLexerModeScript);
+				
+				// The closing tag is lexed as HTML, so the element's content ends just before it.
+				if (c == '<' && RMSHasPrefix(characters, length, index, (script) ? "</script" : "</style"))
+				{
+					mode = kRMSLexerModeText;
+					continue;
+				}
+				
+				if (c == '/' && index + 1 < length && characters[index + 1] == '*')
+				{
+					mode = (script) ? kRMSLexerModeScriptComment : kRMSLexerModeStyleComment;
+					tokenStart = index;
+					index += 2;
+					continue;
+				}
+				
+				if (script && c == '/' && index + 1 < length && characters[index + 1] == '/')
+				{
+					NSUInteger end = RMSFindTerminator(characters, length, index, "</script");
+					RMSEmitToken(index, end, RMSHTMLTokenComment);
+					index = end;
+					continue;
+				}
+				
+				if (c == '"' || c == '\'')
+				{
+					NSUInteger end = RMSEndOfQuotedString(characters, length, index);
+					RMSEmitToken(index, end, RMSHTMLTokenString);
+					index = end;
+					continue;
+				}
+				
+				if (script && RMSIsIdentifierCharacter(c))
+				{
+					NSUInteger end = index + 1;
+					while (end < length && RMSIsIdentifierCharacter(characters[end])) end++;
+					
+					if (RMSIsASCIIDigit(c) == NO && RMSIsJavaScriptKeyword(characters, index, end)) RMSEmitToken(index, end, RMSHTMLTokenKeyword);
+					
+					index = end;
+					continue;
+				}
+				
+				if (script == NO && c == '@')
+				{
+					NSUInteger end = index + 1;
+					while (end < length && RMSIsNameCharacter(characters[end])) end++;
+					
+					RMSEmitToken(index, end, RMSHTMLTokenKeyword);
+					index = end;
+					continue;
+				}
+				
+				index++;
+				break;
+			}
+			
+			default:
+			{
+				// Not a state this lexer produces; start over rather than colour the rest of the document wrongly.
+				mode = kRMSLexerModeText;
+				tagContext = kRMSLexerTagContextNone;
+				break;
+			}
+		}
+	}
+	
+	return RMSLexerMakeState(mode, tagContext);
+}
+
+#undef RMSEmitToken
+
+//***************************************************************************
@@ -0,0 +1,24 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+/// An RWHTMLView that leaves its colouring to an RMSHTMLHighlighter.
+/** RWHTMLView's -didChangeText sends -colorize after every edit, which
+  * lexes the whole document and then replaces all of its characters with
+  * a coloured copy.  That makes every keystroke cost as much as the
+  * document is long, and hands the highlighter, the text storage and the
+  * change bus an edit of the entire text instead of the one that was made.
+  * Here -colorize does nothing, so an edit stays the size it was. */
+@interface RMSHTMLView : RWHTMLView
+
+@end
+
+//***************************************************************************
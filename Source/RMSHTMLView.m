@@ -0,0 +1,30 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+#import "RMSHTMLView.h"
+
+//***************************************************************************
+
+@implementation RMSHTMLView
+
+//***************************************************************************
+
+#pragma mark Colouring
+
+- (void)colorize
+{
+	// The highlighter colours edits as they're processed, and only the lines that need it.
+}
+
+@end
+
+//***************************************************************************
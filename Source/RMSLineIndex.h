@@ -0,0 +1,58 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+/// Whether a line ends after the character, given the one that follows it, or 0 at the end of the text.
+/** Line breaks are the ones -getParagraphStart:end:contentsEnd:forRange:
+  * knows: a line feed, a carriage return, a carriage return and line feed
+  * together, and the Unicode line and paragraph separators. */
+BOOL RMSLineIndexEndsLine(unichar character, unichar nextCharacter);
+
+//***************************************************************************
+
+/// Maps between character offsets and line numbers in O(log n), for documents of any size.
+/** Lines end after each line break, and include it, so a document always
+  * has one more line than it has line breaks; the last one is empty if the
+  * document ends with a line break.
+  *
+  * The line lengths are kept in a B-tree whose nodes also count the lines
+  * and characters beneath them, so finding a line, finding where one
+  * starts, and splicing lines in and out for an edit all take a walk from
+  * the root to a leaf instead of a pass over every line after the edit.
+  * Nodes emptied by deletions are freed, but underfull ones aren't merged:
+  * the tree never gets deeper than the most lines it has held needed. */
+@interface RMSLineIndex : NSObject
+{
+	struct RMSLineIndexNode *root;
+}
+
+- (id)initWithString:(NSString *)string;
+
+/// Re-indexes from scratch.
+- (void)resetWithString:(NSString *)string;
+
+- (NSUInteger)lineCount;
+- (NSUInteger)length;
+
+/// The line the character is on; the index may be the length of the text, which is on the last line.
+- (NSUInteger)lineForCharacterIndex:(NSUInteger)characterIndex;
+
+/// The line's characters, including its line break.
+- (NSRange)rangeOfLine:(NSUInteger)line;
+
+/// Splices an NSTextStorage-style edit into the index; the string is the text after the edit.
+/** Returns the lines the edit replaced, which always includes the line it
+  * started on, and the number of lines that replaced them. */
+- (NSRange)updateForEditedRange:(NSRange)editedRange changeInLength:(NSInteger)changeInLength string:(NSString *)string replacementLineCount:(NSUInteger *)outReplacementLineCount;
+
+@end
+
+//***************************************************************************
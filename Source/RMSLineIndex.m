@@ -0,0 +1,461 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+#import "RMSLineIndex.h"
+
+//***************************************************************************
+
+// Wide enough that a million lines is only four levels deep.
+#define RMSLineIndexNodeCapacity 64
+
+static const NSUInteger kRMSLineIndexScanChunkLength = 4096;
+
+typedef struct RMSLineIndexNode
+{
+	NSUInteger lineCount;
+	NSUInteger length;
+	NSUInteger count;
+	BOOL isLeaf;
+	
+	union
+	{
+		NSUInteger lengths[RMSLineIndexNodeCapacity];
+		struct RMSLineIndexNode *children[RMSLineIndexNodeCapacity];
+	}
+	entries;
+}
+RMSLineIndexNode;
+
+static RMSLineIndexNode *RMSLineIndexNodeCreate(BOOL isLeaf)
+{
+	RMSLineIndexNode *node = calloc(1, sizeof(RMSLineIndexNode));
+	node->isLeaf = isLeaf;
+	
+	return node;
+}
+
+static void RMSLineIndexNodeFree(RMSLineIndexNode *node)
+{
+	if (node->isLeaf == NO)
+	{
+		for (NSUInteger index = 0; index < node->count; index++) RMSLineIndexNodeFree(node->entries.children[index]);
+	}
+	
+	free(node);
+}
+
+static void RMSLineIndexNodeRecount(RMSLineIndexNode *node)
+{
+	node->lineCount = 0;
+	node->length = 0;
+	
+	for (NSUInteger index = 0; index < node->count; index++)
+	{
+		if (node->isLeaf)
+		{
+			node->lineCount++;
+			node->length += node->entries.lengths[index];
+		}
+		else
+		{
+			node->lineCount += node->entries.children[index]->lineCount;
+			node->length += node->entries.children[index]->length;
+		}
+	}
+}
+
+/// Moves the top half of a full node into a new one, and returns it.
+static RMSLineIndexNode *RMSLineIndexNodeSplit(RMSLineIndexNode *node)
+{
+	RMSLineIndexNode *right = RMSLineIndexNodeCreate(node->isLeaf);
+	NSUInteger half = node->count / 2;
+	
+	right->count = node->count - half;
+	
+	if (node->isLeaf) memcpy(right->entries.lengths, node->entries.lengths + half, right->count * sizeof(NSUInteger));
+	else memcpy(right->entries.children, node->entries.children + half, right->count * sizeof(RMSLineIndexNode *));
+	
+	node->count = half;
+	
+	RMSLineIndexNodeRecount(node);
+	RMSLineIndexNodeRecount(right);
+	
+	return right;
+}
+
+/// Inserts a line before the given one, and returns the node's new right-hand sibling if it had to split.
+static RMSLineIndexNode *RMSLineIndexNodeInsert(RMSLineIndexNode *node, NSUInteger line, NSUInteger length)
+{
+	node->lineCount++;
+	node->length += length;
+	
+	if (node->isLeaf)
+	{
+		NSUInteger *lengths = node->entries.lengths;
+		
+		memmove(lengths + line + 1, lengths + line, (node->count - line) * sizeof(NSUInteger));
+		lengths[line] = length;
+		node->count++;
+	}
+	else
+	{
+		RMSLineIndexNode **children = node->entries.children;
+		NSUInteger index = 0;
+		
+		// A line that goes between two children is appended to the first.
+		while (index + 1 < node->count && line > children[index]->lineCount)
+		{
+			line -= children[index]->lineCount;
+			index++;
+		}
+		
+		RMSLineIndexNode *sibling = RMSLineIndexNodeInsert(children[index], line, length);
+		
+		if (sibling)
+		{
+			memmove(children + index + 2, children + index + 1, (node->count - index - 1) * sizeof(RMSLineIndexNode *));
+			children[index + 1] = sibling;
+			node->count++;
+		}
+	}
+	
+	return (node->count == RMSLineIndexNodeCapacity) ? RMSLineIndexNodeSplit(node) : NULL;
+}
+
+/// Removes a line, and returns its length.
+static NSUInteger RMSLineIndexNodeRemove(RMSLineIndexNode *node, NSUInteger line)
+{
+	NSUInteger length;
+	
+	if (node->isLeaf)
+	{
+		NSUInteger *lengths = node->entries.lengths;
+		
+		length = lengths[line];
+		memmove(lengths + line, lengths + line + 1, (node->count - line - 1) * sizeof(NSUInteger));
+		node->count--;
+	}
+	else
+	{
+		RMSLineIndexNode **children = node->entries.children;
+		NSUInteger index = 0;
+		
+		while (line >= children[index]->lineCount)
+		{
+			line -= children[index]->lineCount;
+			index++;
+		}
+		
+		RMSLineIndexNode *child = children[index];
+		length = RMSLineIndexNodeRemove(child, line);
+		
+		if (child->count == 0)
+		{
+			free(child);
+			memmove(children + index, children + index + 1, (node->count - index - 1) * sizeof(RMSLineIndexNode *));
+			node->count--;
+		}
+	}
+	
+	node->lineCount--;
+	node->length -= length;
+	
+	return length;
+}
+
+static void RMSLineIndexNodeAdjustLength(RMSLineIndexNode *node, NSUInteger line, NSInteger changeInLength)
+{
+	while (node->isLeaf == NO)
+	{
+		node->length += changeInLength;
+		
+		RMSLineIndexNode **children = node->entries.children;
+		NSUInteger index = 0;
+		
+		while (line >= children[index]->lineCount)
+		{
+			line -= children[index]->lineCount;
+			index++;
+		}
+		
+		node = children[index];
+	}
+	
+	node->length += changeInLength;
+	node->entries.lengths[line] += changeInLength;
+}
+
+BOOL RMSLineIndexEndsLine(unichar character, unichar nextCharacter)
+{
+	switch (character)
+	{
+		case '\n':
+		case 0x2028:
+		case 0x2029:
+			return YES;
+		case '\r':
+			return (nextCharacter != '\n');
+		default:
+			return NO;
+	}
+}
+
+/// Appends the length of every line that ends inside the range, measured from the given start, and returns where the next line starts.
+/** A carriage return at the end of the range is looked past, so it isn't
+  * taken for a line break of its own when a line feed follows it. */
+static NSUInteger RMSLineIndexAppendLineLengths(NSString *string, NSRange range, NSUInteger lineStart, NSMutableData *lengths)
+{
+	NSUInteger stringLength = [string length];
+	unichar buffer[kRMSLineIndexScanChunkLength + 1];
+	
+	for (NSUInteger chunkStart = range.location; chunkStart < NSMaxRange(range); chunkStart += kRMSLineIndexScanChunkLength)
+	{
+		NSUInteger chunkLength = MIN(kRMSLineIndexScanChunkLength, NSMaxRange(range) - chunkStart);
+		
+		// One character more than the chunk, where there is one, for the character after its last.
+		NSUInteger readLength = MIN(chunkLength + 1, stringLength - chunkStart);
+		[string getCharacters:buffer range:NSMakeRange(chunkStart, readLength)];
+		if (readLength == chunkLength) buffer[chunkLength] = 0;
+		
+		for (NSUInteger index = 0; index < chunkLength; index++)
+		{
+			if (RMSLineIndexEndsLine(buffer[index], buffer[index + 1]) == NO) continue;
+			
+			NSUInteger nextLineStart = chunkStart + index + 1;
+			NSUInteger lineLength = nextLineStart - lineStart;
+			
+			[lengths appendBytes:&lineLength length:sizeof(lineLength)];
+			lineStart = nextLineStart;
+		}
+	}
+	
+	return lineStart;
+}
+
+//***************************************************************************
+
+@implementation RMSLineIndex
+
+//***************************************************************************
+
+#pragma mark Lines
+
+- (void)insertLineWithLength:(NSUInteger)length atLine:(NSUInteger)line
+{
+	RMSLineIndexNode *sibling = RMSLineIndexNodeInsert(root, line, length);
+	
+	if (sibling)
+	{
+		RMSLineIndexNode *newRoot = RMSLineIndexNodeCreate(NO);
+		
+		newRoot->entries.children[0] = root;
+		newRoot->entries.children[1] = sibling;
+		newRoot->count = 2;
+		RMSLineIndexNodeRecount(newRoot);
+		
+		root = newRoot;
+	}
+}
+
+- (void)removeLine:(NSUInteger)line
+{
+	RMSLineIndexNodeRemove(root, line);
+	
+	while (root->isLeaf == NO && root->count == 1)
+	{
+		RMSLineIndexNode *child = root->entries.children[0];
+		
+		free(root);
+		root = child;
+	}
+}
+
+/// Lines the two ranges have in common are resized in place; only the difference is inserted or removed.
+- (void)replaceLinesInRange:(NSRange)lineRange withLengths:(const NSUInteger *)lengths count:(NSUInteger)count
+{
+	NSUInteger commonCount = MIN(lineRange.length, count);
+	
+	for (NSUInteger index = 0; index < commonCount; index++)
+	{
+		NSUInteger line = lineRange.location + index;
+		NSInteger changeInLength = (NSInteger)lengths[index] - (NSInteger)[self rangeOfLine:line].length;
+		
+		if (changeInLength != 0) RMSLineIndexNodeAdjustLength(root, line, changeInLength);
+	}
+	
+	for (NSUInteger index = commonCount; index < count; index++)
+	{
+		[self insertLineWithLength:lengths[index] atLine:(lineRange.location + index)];
+	}
+	
+	for (NSUInteger index = commonCount; index < lineRange.length; index++)
+	{
+		[self removeLine:(lineRange.location + count)];
+	}
+}
+
+//***************************************************************************
+
+#pragma mark Queries
+
+- (NSUInteger)lineCount
+{
+	return root->lineCount;
+}
+
+- (NSUInteger)length
+{
+	return root->length;
+}
+
+- (NSUInteger)lineForCharacterIndex:(NSUInteger)characterIndex
+{
+	RMSLineIndexNode *node = root;
+	NSUInteger line = 0;
+	
+	// Anything past the last line break, including the end of the text, is on the last line.
+	while (node->isLeaf == NO)
+	{
+		RMSLineIndexNode **children = node->entries.children;
+		NSUInteger index = 0;
+		
+		while (index + 1 < node->count && characterIndex >= children[index]->length)
+		{
+			characterIndex -= children[index]->length;
+			line += children[index]->lineCount;
+			index++;
+		}
+		
+		node = children[index];
+	}
+	
+	NSUInteger index = 0;
+	
+	while (index + 1 < node->count && characterIndex >= node->entries.lengths[index])
+	{
+		characterIndex -= node->entries.lengths[index];
+		index++;
+	}
+	
+	return line + index;
+}
+
+- (NSRange)rangeOfLine:(NSUInteger)line
+{
+	RMSLineIndexNode *node = root;
+	NSUInteger location = 0;
+	
+	while (node->isLeaf == NO)
+	{
+		RMSLineIndexNode **children = node->entries.children;
+		NSUInteger index = 0;
+		
+		while (line >= children[index]->lineCount)
+		{
+			line -= children[index]->lineCount;
+			location += children[index]->length;
+			index++;
+		}
+		
+		node = children[index];
+	}
+	
+	for (NSUInteger index = 0; index < line; index++) location += node->entries.lengths[index];
+	
+	return NSMakeRange(location, node->entries.lengths[line]);
+}
+
+//***************************************************************************
+
+#pragma mark Editing
+
+- (void)resetWithString:(NSString *)string
+{
+	if (root) RMSLineIndexNodeFree(root);
+	root = RMSLineIndexNodeCreate(YES);
+	
+	NSMutableData *lengths = [NSMutableData data];
+	NSUInteger lastLineStart = RMSLineIndexAppendLineLengths(string, NSMakeRange(0, [string length]), 0, lengths);
+	NSUInteger lastLineLength = [string length] - lastLineStart;
+	
+	[lengths appendBytes:&lastLineLength length:sizeof(lastLineLength)];
+	
+	const NSUInteger *lineLengths = [lengths bytes];
+	NSUInteger lineCount = [lengths length] / sizeof(NSUInteger);
+	
+	for (NSUInteger line = 0; line < lineCount; line++)
+	{
+		[self insertLineWithLength:lineLengths[line] atLine:line];
+	}
+}
+
+- (NSRange)updateForEditedRange:(NSRange)editedRange changeInLength:(NSInteger)changeInLength string:(NSString *)string replacementLineCount:(NSUInteger *)outReplacementLineCount
+{
+	NSUInteger oldEditEnd = NSMaxRange(editedRange) - changeInLength;
+	
+	// Whether a line ends after a character depends on the one after it, so the character before the edit is looked at again: a line feed typed after a carriage return joins it into one line break, and deleting the line feed splits them.
+	NSUInteger scanStart = (editedRange.location > 0) ? editedRange.location - 1 : 0;
+	
+	// Every line that starts inside the replaced text goes, along with the one the scan starts on.
+	NSUInteger firstLine = [self lineForCharacterIndex:scanStart];
+	NSUInteger lastLine = [self lineForCharacterIndex:oldEditEnd];
+	
+	NSUInteger spanStart = [self rangeOfLine:firstLine].location;
+	NSUInteger spanEnd = NSMaxRange([self rangeOfLine:lastLine]) + changeInLength;
+	
+	NSMutableData *lengths = [NSMutableData data];
+	NSUInteger lastLineStart = RMSLineIndexAppendLineLengths(string, NSMakeRange(scanStart, NSMaxRange(editedRange) - scanStart), spanStart, lengths);
+	NSUInteger lastLineLength = spanEnd - lastLineStart;
+	
+	[lengths appendBytes:&lastLineLength length:sizeof(lastLineLength)];
+	
+	NSRange replacedLines = NSMakeRange(firstLine, lastLine - firstLine + 1);
+	NSUInteger replacementLineCount = [lengths length] / sizeof(NSUInteger);
+	
+	[self replaceLinesInRange:replacedLines withLengths:[lengths bytes] count:replacementLineCount];
+	
+	if (outReplacementLineCount) *outReplacementLineCount = replacementLineCount;
+	
+	return replacedLines;
+}
+
+//***************************************************************************
+
+#pragma mark Object Lifecycle
+
+- (id)initWithString:(NSString *)string
+{
+	self = [super init];
+	
+	if (self)
+	{
+		[self resetWithString:string];
+	}
+	
+	return self;
+}
+
+- (id)init
+{
+	return [self initWithString:@""];
+}
+
+- (void)dealloc
+{
+	if (root) RMSLineIndexNodeFree(root);
+	
+	[super dealloc];
+}
+
+@end
+
+//***************************************************************************
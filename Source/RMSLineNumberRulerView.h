@@ -0,0 +1,37 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+@class RMSLineIndex;
+
+//***************************************************************************
+
+/// A line number gutter that only ever looks at the lines on screen.
+/** The first visible line comes from the line index, and numbers are drawn
+  * down from there until they pass the bottom of the view, so the cost of
+  * drawing doesn't depend on the size of the document.  The index has to
+  * be kept up to date by someone else, usually an RMSHTMLHighlighter. */
+@interface RMSLineNumberRulerView : NSRulerView
+{
+	NSTextView *textView;
+	RMSLineIndex *lineIndex;
+	
+	NSDictionary *numberAttributes;
+}
+
+- (id)initWithTextView:(NSTextView *)aTextView lineIndex:(RMSLineIndex *)aLineIndex;
+
+/// Stops observing the text view; must be sent before the text view goes away.
+- (void)invalidate;
+
+@end
+
+//***************************************************************************
@@ -0,0 +1,149 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+#import "RMSLineNumberRulerView.h"
+#import "RMSLineIndex.h"
+
+//***************************************************************************
+
+static const CGFloat kRMSLineNumberRulerPadding = 5.0;
+
+// Short documents still get room for three digits, so the gutter doesn't keep changing width as lines are added.
+static const NSUInteger kRMSLineNumberRulerMinimumDigitCount = 3;
+
+//***************************************************************************
+
+@implementation RMSLineNumberRulerView
+
+//***************************************************************************
+
+#pragma mark Drawing
+
+- (void)updateRuleThickness
+{
+	NSUInteger digitCount = MAX([[NSString stringWithFormat:@"%lu", (unsigned long)[lineIndex lineCount]] length], kRMSLineNumberRulerMinimumDigitCount);
+	CGFloat digitWidth = [@"8" sizeWithAttributes:numberAttributes].width;
+	CGFloat thickness = ceil(digitCount * digitWidth + 2.0 * kRMSLineNumberRulerPadding);
+	
+	if (thickness != [self ruleThickness]) [self setRuleThickness:thickness];
+}
+
+- (void)drawHashMarksAndLabelsInRect:(NSRect)rect
+{
+	NSLayoutManager *layoutManager = [textView layoutManager];
+	NSUInteger textLength = [[textView textStorage] length];
+	
+	// Between an edit and the index catching up with it there's nothing sensible to draw.
+	if (layoutManager == nil || [lineIndex length] != textLength) return;
+	
+	NSPoint containerOrigin = [textView textContainerOrigin];
+	NSRect visibleRect = NSOffsetRect([textView visibleRect], -containerOrigin.x, -containerOrigin.y);
+	NSRange glyphRange = [layoutManager glyphRangeForBoundingRect:visibleRect inTextContainer:[textView textContainer]];
+	NSRange characterRange = [layoutManager characterRangeForGlyphRange:glyphRange actualGlyphRange:NULL];
+	
+	NSUInteger lineCount = [lineIndex lineCount];
+	
+	for (NSUInteger line = [lineIndex lineForCharacterIndex:characterRange.location]; line < lineCount; line++)
+	{
+		NSUInteger lineStart = [lineIndex rangeOfLine:line].location;
+		if (lineStart > NSMaxRange(characterRange)) break;
+		
+		// The empty line after a trailing line break has no glyphs, just the extra line fragment.
+		NSRect fragmentRect;
+		
+		if (lineStart < textLength) fragmentRect = [layoutManager lineFragmentRectForGlyphAtIndex:[layoutManager glyphIndexForCharacterAtIndex:lineStart] effectiveRange:NULL];
+		else fragmentRect = [layoutManager extraLineFragmentRect];
+		
+		if (NSIsEmptyRect(fragmentRect)) continue;
+		
+		NSRect numberRect = [self convertRect:NSOffsetRect(fragmentRect, containerOrigin.x, containerOrigin.y) fromView:textView];
+		if (NSIntersectsRect(numberRect, rect) == NO) continue;
+		
+		NSString *number = [NSString stringWithFormat:@"%lu", (unsigned long)(line + 1)];
+		NSSize numberSize = [number sizeWithAttributes:numberAttributes];
+		NSPoint numberPoint = NSMakePoint([self ruleThickness] - kRMSLineNumberRulerPadding - numberSize.width, NSMidY(numberRect) - numberSize.height / 2.0);
+		
+		[number drawAtPoint:numberPoint withAttributes:numberAttributes];
+	}
+}
+
+//***************************************************************************
+
+#pragma mark Notifications
+
+- (void)textDidChange:(NSNotification *)notification
+{
+	[self updateRuleThickness];
+	[self setNeedsDisplay:YES];
+}
+
+- (void)visibleRectDidChange:(NSNotification *)notification
+{
+	[self setNeedsDisplay:YES];
+}
+
+//***************************************************************************
+
+#pragma mark Object Lifecycle
+
+- (id)initWithTextView:(NSTextView *)aTextView lineIndex:(RMSLineIndex *)aLineIndex
+{
+	self = [super initWithScrollView:[aTextView enclosingScrollView] orientation:NSVerticalRuler];
+	
+	if (self)
+	{
+		textView = aTextView;
+		lineIndex = [aLineIndex retain];
+		
+		NSFont *font = [NSFont labelFontOfSize:[NSFont labelFontSize]];
+		numberAttributes = [[NSDictionary alloc] initWithObjectsAndKeys:font, NSFontAttributeName, [NSColor disabledControlTextColor], NSForegroundColorAttributeName, nil];
+		
+		[self setClientView:textView];
+		[self updateRuleThickness];
+		
+		NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+		[center addObserver:self selector:@selector(textDidChange:) name:NSTextDidChangeNotification object:textView];
+		[center addObserver:self selector:@selector(visibleRectDidChange:) name:NSViewFrameDidChangeNotification object:textView];
+		
+		NSClipView *clipView = [[textView enclosingScrollView] contentView];
+		
+		if (clipView)
+		{
+			[clipView setPostsBoundsChangedNotifications:YES];
+			[center addObserver:self selector:@selector(visibleRectDidChange:) name:NSViewBoundsDidChangeNotification object:clipView];
+		}
+	}
+	
+	return self;
+}
+
+- (void)invalidate
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	
+	[self setClientView:nil];
+	textView = nil;
+}
+
+- (void)dealloc
+{
+	[self invalidate];
+	
+	[lineIndex release];
+	[numberAttributes release];
+	
+	[super dealloc];
+}
+
+@end
+
+//***************************************************************************
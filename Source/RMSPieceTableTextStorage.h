@@ -0,0 +1,66 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+struct RMSTextNode;
+
+@class RMSPieceTableBuffer;
+@class RMSPieceTableString;
+
+//***************************************************************************
+
+/// A text storage for very large documents, which edits in O(log n) and snapshots in O(1).
+/** The text is a piece table: a sequence of pieces, each a range of either
+  * a string the storage was given or an append-only buffer that typed and
+  * pasted text goes into, so no edit ever moves the text after it.  The
+  * pieces, and the attribute runs, are each kept in a balanced tree
+  * ordered by character offset, where finding, splitting and joining runs
+  * all take O(log n).
+  *
+  * The trees are persistent: an edit builds new nodes along the path it
+  * changes and shares everything else with the previous version.  Taking a
+  * snapshot only retains the root, and the snapshot stays valid, and safe
+  * to read from any thread, whatever happens to the storage afterwards.
+  * -copy on the storage's -string returns one, so code that copies the text
+  * before handing it to a background thread gets this for free.
+  *
+  * That only holds for edits that are the size of the change.  Anything
+  * that replaces the whole text after every edit, as RWHTMLView's -colorize
+  * does, makes each one copy the document into a new piece and rebuild the
+  * attribute runs from scratch, so colour with temporary attributes on the
+  * layout manager instead (see RMSHTMLView and RMSHTMLHighlighter).
+  *
+  * Install it behind an existing text view with -[NSLayoutManager replaceTextStorage:]. */
+@interface RMSPieceTableTextStorage : NSTextStorage
+{
+	struct RMSTextNode *textRoot;
+	struct RMSTextNode *attributeRoot;
+	NSUInteger editCount;
+	uint32_t prioritySeed;
+	
+	RMSPieceTableBuffer *appendBuffer;
+	RMSPieceTableString *string;
+	
+	RMSPieceTableString *snapshot;
+	NSUInteger snapshotEditCount;
+}
+
+/// Goes up by one with every change to the characters; changes to attributes don't count.
+- (NSUInteger)editCount;
+
+/// An immutable copy of the current text, in O(1).
+/** Snapshots are versioned by -editCount: until the text is next edited,
+  * every call returns the same object. */
+- (NSString *)snapshotString;
+
+@end
+
+//***************************************************************************
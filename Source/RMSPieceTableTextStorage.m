@@ -0,0 +1,710 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+#include <libkern/OSAtomic.h>
+
+#import "RMSPieceTableTextStorage.h"
+
+//***************************************************************************
+
+// Typing and small pastes are copied into shared buffers of this size; anything bigger keeps its own string.
+static const NSUInteger kRMSPieceTableBufferCapacity = 16384;
+
+//***************************************************************************
+
+#pragma mark Trees
+
+/// A node in a piece tree or an attribute run tree, which are both treaps ordered by character offset.
+/** Nodes are immutable once they're shared, and reference counted so that
+  * any number of versions of a tree can share them.  In a piece tree the
+  * object is the string or buffer the piece's characters come from; in an
+  * attribute tree it's the run's attributes. */
+typedef struct RMSTextNode
+{
+	struct RMSTextNode *left;
+	struct RMSTextNode *right;
+	volatile int32_t referenceCount;
+	uint32_t priority;
+	
+	NSUInteger length;
+	NSUInteger totalLength;
+	
+	id object;
+	const unichar *characters;
+	NSUInteger offset;
+}
+RMSTextNode;
+
+typedef void (*RMSTextNodeFunction)(const RMSTextNode *node, NSRange nodeRange, NSUInteger location, void *context);
+
+static NSUInteger RMSTextNodeTotalLength(const RMSTextNode *node)
+{
+	return node ? node->totalLength : 0;
+}
+
+static RMSTextNode *RMSTextNodeRetain(RMSTextNode *node)
+{
+	if (node) OSAtomicIncrement32Barrier(&node->referenceCount);
+	
+	return node;
+}
+
+static void RMSTextNodeRelease(RMSTextNode *node)
+{
+	if (node == NULL || OSAtomicDecrement32Barrier(&node->referenceCount) != 0) return;
+	
+	RMSTextNodeRelease(node->left);
+	RMSTextNodeRelease(node->right);
+	[node->object release];
+	
+	free(node);
+}
+
+/// Makes a node with part of another's contents, taking over the references to its children.
+static RMSTextNode *RMSTextNodeCreate(const RMSTextNode *contents, NSUInteger start, NSUInteger length, uint32_t priority, RMSTextNode *left, RMSTextNode *right)
+{
+	RMSTextNode *node = malloc(sizeof(RMSTextNode));
+	
+	node->left = left;
+	node->right = right;
+	node->referenceCount = 1;
+	node->priority = priority;
+	
+	node->length = length;
+	node->totalLength = RMSTextNodeTotalLength(left) + length + RMSTextNodeTotalLength(right);
+	
+	node->object = [contents->object retain];
+	node->characters = contents->characters ? contents->characters + start : NULL;
+	node->offset = contents->offset + start;
+	
+	return node;
+}
+
+/// Splits a tree at a character index into two new trees, leaving the original alone.
+static void RMSTextNodeSplit(RMSTextNode *node, NSUInteger index, RMSTextNode **outLeft, RMSTextNode **outRight)
+{
+	if (node == NULL || index == 0 || index >= node->totalLength)
+	{
+		*outLeft = (node && index > 0) ? RMSTextNodeRetain(node) : NULL;
+		*outRight = (node && index == 0) ? RMSTextNodeRetain(node) : NULL;
+		return;
+	}
+	
+	NSUInteger leftLength = RMSTextNodeTotalLength(node->left);
+	RMSTextNode *left;
+	RMSTextNode *right;
+	
+	if (index <= leftLength)
+	{
+		RMSTextNodeSplit(node->left, index, &left, &right);
+		
+		*outLeft = left;
+		*outRight = RMSTextNodeCreate(node, 0, node->length, node->priority, right, RMSTextNodeRetain(node->right));
+	}
+	else if (index >= leftLength + node->length)
+	{
+		RMSTextNodeSplit(node->right, index - leftLength - node->length, &left, &right);
+		
+		*outLeft = RMSTextNodeCreate(node, 0, node->length, node->priority, RMSTextNodeRetain(node->left), left);
+		*outRight = right;
+	}
+	else
+	{
+		// The index falls inside this node's run, so it becomes two.
+		NSUInteger cut = index - leftLength;
+		
+		*outLeft = RMSTextNodeCreate(node, 0, cut, node->priority, RMSTextNodeRetain(node->left), NULL);
+		*outRight = RMSTextNodeCreate(node, cut, node->length - cut, node->priority, NULL, RMSTextNodeRetain(node->right));
+	}
+}
+
+/// Joins two trees end to end, taking over the references to both.
+static RMSTextNode *RMSTextNodeMerge(RMSTextNode *left, RMSTextNode *right)
+{
+	if (left == NULL) return right;
+	if (right == NULL) return left;
+	
+	RMSTextNode *node;
+	
+	if (left->priority > right->priority)
+	{
+		// A node nothing else refers to can be changed in place instead of copied.
+		if (left->referenceCount == 1)
+		{
+			left->right = RMSTextNodeMerge(left->right, right);
+			left->totalLength = RMSTextNodeTotalLength(left->left) + left->length + RMSTextNodeTotalLength(left->right);
+			return left;
+		}
+		
+		node = RMSTextNodeCreate(left, 0, left->length, left->priority, RMSTextNodeRetain(left->left), RMSTextNodeMerge(RMSTextNodeRetain(left->right), right));
+		RMSTextNodeRelease(left);
+	}
+	else
+	{
+		if (right->referenceCount == 1)
+		{
+			right->left = RMSTextNodeMerge(left, right->left);
+			right->totalLength = RMSTextNodeTotalLength(right->left) + right->length + RMSTextNodeTotalLength(right->right);
+			return right;
+		}
+		
+		node = RMSTextNodeCreate(right, 0, right->length, right->priority, RMSTextNodeMerge(left, RMSTextNodeRetain(right->left)), RMSTextNodeRetain(right->right));
+		RMSTextNodeRelease(right);
+	}
+	
+	return node;
+}
+
+/// Replaces a range of a tree with another tree, which may be NULL, and returns the new tree; the original is left alone.
+static RMSTextNode *RMSTextNodeReplace(RMSTextNode *root, NSRange range, RMSTextNode *replacement)
+{
+	RMSTextNode *before;
+	RMSTextNode *rest;
+	RMSTextNode *replaced;
+	RMSTextNode *after;
+	
+	RMSTextNodeSplit(root, range.location, &before, &rest);
+	RMSTextNodeSplit(rest, range.length, &replaced, &after);
+	
+	RMSTextNodeRelease(rest);
+	RMSTextNodeRelease(replaced);
+	
+	return RMSTextNodeMerge(RMSTextNodeMerge(before, replacement), after);
+}
+
+/// Finds the node that holds a character, and where its run starts.
+static const RMSTextNode *RMSTextNodeFind(const RMSTextNode *node, NSUInteger index, NSUInteger *outStart)
+{
+	NSUInteger start = 0;
+	
+	while (node)
+	{
+		NSUInteger leftLength = RMSTextNodeTotalLength(node->left);
+		
+		if (index < leftLength)
+		{
+			node = node->left;
+		}
+		else if (index < leftLength + node->length)
+		{
+			*outStart = start + leftLength;
+			return node;
+		}
+		else
+		{
+			index -= leftLength + node->length;
+			start += leftLength + node->length;
+			node = node->right;
+		}
+	}
+	
+	return NULL;
+}
+
+/// Calls the function, in order, for the part of every node's run that falls in the range.
+static void RMSTextNodeEnumerate(const RMSTextNode *node, NSUInteger nodeStart, NSRange range, RMSTextNodeFunction function, void *context)
+{
+	if (node == NULL || range.length == 0) return;
+	
+	NSUInteger runStart = nodeStart + RMSTextNodeTotalLength(node->left);
+	NSUInteger runEnd = runStart + node->length;
+	
+	if (range.location < runStart) RMSTextNodeEnumerate(node->left, nodeStart, range, function, context);
+	
+	NSUInteger start = MAX(range.location, runStart);
+	NSUInteger end = MIN(NSMaxRange(range), runEnd);
+	
+	if (start < end) function(node, NSMakeRange(start - runStart, end - start), start, context);
+	
+	if (NSMaxRange(range) > runEnd) RMSTextNodeEnumerate(node->right, runEnd, range, function, context);
+}
+
+static void RMSTextNodeCopyCharacters(const RMSTextNode *node, NSRange nodeRange, NSUInteger location, void *context)
+{
+	unichar *buffer = *(unichar **)context;
+	
+	if (node->characters) memcpy(buffer, node->characters + nodeRange.location, nodeRange.length * sizeof(unichar));
+	else [node->object getCharacters:buffer range:NSMakeRange(node->offset + nodeRange.location, nodeRange.length)];
+	
+	*(unichar **)context = buffer + nodeRange.length;
+}
+
+//***************************************************************************
+
+#pragma mark -
+
+/// Fixed-size storage for inserted text; characters are only ever appended, so pieces can point straight into it.
+@interface RMSPieceTableBuffer : NSObject
+{
+	unichar *characters;
+	NSUInteger length;
+	NSUInteger capacity;
+}
+
+- (id)initWithCapacity:(NSUInteger)aCapacity;
+
+/// Returns where the characters went, or NULL if there isn't room for them.
+- (const unichar *)appendCharactersOfString:(NSString *)aString;
+
+@end
+
+@implementation RMSPieceTableBuffer
+
+- (const unichar *)appendCharactersOfString:(NSString *)aString
+{
+	NSUInteger stringLength = [aString length];
+	if (capacity - length < stringLength) return NULL;
+	
+	unichar *destination = characters + length;
+	[aString getCharacters:destination range:NSMakeRange(0, stringLength)];
+	length += stringLength;
+	
+	return destination;
+}
+
+- (id)initWithCapacity:(NSUInteger)aCapacity
+{
+	self = [super init];
+	
+	if (self)
+	{
+		characters = malloc(aCapacity * sizeof(unichar));
+		
+		if (characters == NULL)
+		{
+			[self release];
+			return nil;
+		}
+		
+		capacity = aCapacity;
+	}
+	
+	return self;
+}
+
+- (void)dealloc
+{
+	free(characters);
+	
+	[super dealloc];
+}
+
+@end
+
+//***************************************************************************
+
+#pragma mark -
+
+@interface RMSPieceTableTextStorage (RMSPieceTableString)
+
+- (RMSTextNode *)textRoot;
+
+@end
+
+/// The storage's text, either live or as a snapshot.
+@interface RMSPieceTableString : NSString
+{
+	RMSPieceTableTextStorage *textStorage;
+	RMSTextNode *snapshotRoot;
+	
+	// The last piece the live string read from, as most reads carry on from where the last one stopped.
+	const RMSTextNode *cachedNode;
+	NSUInteger cachedStart;
+	NSUInteger cachedEditCount;
+}
+
+/// A live string follows the storage's edits; it doesn't retain the storage.
+- (id)initWithTextStorage:(RMSPieceTableTextStorage *)aTextStorage;
+
+/// A snapshot retains the root it's given and never changes.
+- (id)initWithRoot:(RMSTextNode *)aRoot;
+
+/// Turns a live string into a snapshot, for when the storage goes away before it.
+- (void)detachFromTextStorage;
+
+@end
+
+@implementation RMSPieceTableString
+
+- (RMSTextNode *)root
+{
+	return textStorage ? [textStorage textRoot] : snapshotRoot;
+}
+
+- (NSUInteger)length
+{
+	return RMSTextNodeTotalLength([self root]);
+}
+
+- (unichar)characterAtIndex:(NSUInteger)index
+{
+	const RMSTextNode *piece;
+	NSUInteger pieceStart;
+	
+	// Only the live string, which belongs to the main thread like its storage, keeps a cursor; snapshots can be read from several threads at once, so they look the piece up every time.
+	if (textStorage)
+	{
+		NSUInteger editCount = [textStorage editCount];
+		
+		if (cachedNode == NULL || editCount != cachedEditCount || index < cachedStart || index >= cachedStart + cachedNode->length)
+		{
+			cachedNode = RMSTextNodeFind([textStorage textRoot], index, &cachedStart);
+			cachedEditCount = editCount;
+		}
+		
+		piece = cachedNode;
+		pieceStart = cachedStart;
+	}
+	else
+	{
+		piece = RMSTextNodeFind(snapshotRoot, index, &pieceStart);
+	}
+	
+	if (piece == NULL) [NSException raise:NSRangeException format:@"%@: index %lu is out of bounds", NSStringFromSelector(_cmd), (unsigned long)index];
+	
+	NSUInteger pieceIndex = index - pieceStart;
+	
+	if (piece->characters) return piece->characters[pieceIndex];
+	
+	return [piece->object characterAtIndex:(piece->offset + pieceIndex)];
+}
+
+- (void)getCharacters:(unichar *)buffer range:(NSRange)range
+{
+	RMSTextNode *root = [self root];
+	
+	if (NSMaxRange(range) > RMSTextNodeTotalLength(root)) [NSException raise:NSRangeException format:@"%@: range %@ is out of bounds", NSStringFromSelector(_cmd), NSStringFromRange(range)];
+	
+	RMSTextNodeEnumerate(root, 0, range, RMSTextNodeCopyCharacters, &buffer);
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+	if (textStorage) return [[textStorage snapshotString] retain];
+	
+	return [self retain];
+}
+
+- (Class)classForCoder
+{
+	// Archived text, like a saved page, comes back as an ordinary string; there's no storage to decode into.
+	return [NSString class];
+}
+
+- (void)detachFromTextStorage
+{
+	if (textStorage == nil) return;
+	
+	snapshotRoot = RMSTextNodeRetain([textStorage textRoot]);
+	textStorage = nil;
+	cachedNode = NULL;
+}
+
+- (id)initWithTextStorage:(RMSPieceTableTextStorage *)aTextStorage
+{
+	self = [super init];
+	
+	if (self)
+	{
+		textStorage = aTextStorage;
+	}
+	
+	return self;
+}
+
+- (id)initWithRoot:(RMSTextNode *)aRoot
+{
+	self = [super init];
+	
+	if (self)
+	{
+		snapshotRoot = RMSTextNodeRetain(aRoot);
+	}
+	
+	return self;
+}
+
+- (void)dealloc
+{
+	RMSTextNodeRelease(snapshotRoot);
+	
+	[super dealloc];
+}
+
+@end
+
+//***************************************************************************
+
+#pragma mark -
+
+@implementation RMSPieceTableTextStorage
+
+//***************************************************************************
+
+#pragma mark Pieces
+
+- (uint32_t)nextPriority
+{
+	// xorshift; the priorities only have to be spread out, not unpredictable.
+	prioritySeed ^= prioritySeed << 13;
+	prioritySeed ^= prioritySeed >> 17;
+	prioritySeed ^= prioritySeed << 5;
+	
+	return prioritySeed;
+}
+
+- (RMSTextNode *)newPieceWithString:(NSString *)aString
+{
+	NSUInteger length = [aString length];
+	if (length == 0) return NULL;
+	
+	RMSTextNode contents = { NULL, NULL, 0, 0, 0, 0, nil, NULL, 0 };
+	
+	if (length > kRMSPieceTableBufferCapacity / 4)
+	{
+		// An immutable string's copy is itself, so a big paste or -setString: costs nothing here.
+		NSString *copy = [aString copy];
+		
+		contents.object = copy;
+		RMSTextNode *node = RMSTextNodeCreate(&contents, 0, length, [self nextPriority], NULL, NULL);
+		[copy release];
+		
+		return node;
+	}
+	
+	const unichar *characters = [appendBuffer appendCharactersOfString:aString];
+	
+	if (characters == NULL)
+	{
+		[appendBuffer release];
+		appendBuffer = [[RMSPieceTableBuffer alloc] initWithCapacity:kRMSPieceTableBufferCapacity];
+		characters = [appendBuffer appendCharactersOfString:aString];
+	}
+	
+	contents.object = appendBuffer;
+	contents.characters = characters;
+	
+	return RMSTextNodeCreate(&contents, 0, length, [self nextPriority], NULL, NULL);
+}
+
+- (RMSTextNode *)newRunWithAttributes:(NSDictionary *)attributes length:(NSUInteger)length
+{
+	if (length == 0) return NULL;
+	
+	RMSTextNode contents = { NULL, NULL, 0, 0, 0, 0, nil, NULL, 0 };
+	contents.object = attributes ? attributes : [NSDictionary dictionary];
+	
+	return RMSTextNodeCreate(&contents, 0, length, [self nextPriority], NULL, NULL);
+}
+
+- (RMSTextNode *)textRoot
+{
+	return textRoot;
+}
+
+- (NSUInteger)editCount
+{
+	return editCount;
+}
+
+- (NSString *)snapshotString
+{
+	if (snapshot == nil || snapshotEditCount != editCount)
+	{
+		[snapshot release];
+		snapshot = [[RMSPieceTableString alloc] initWithRoot:textRoot];
+		snapshotEditCount = editCount;
+	}
+	
+	return [[snapshot retain] autorelease];
+}
+
+//***************************************************************************
+
+#pragma mark NSTextStorage Primitives
+
+- (NSString *)string
+{
+	return string;
+}
+
+- (NSDictionary *)attributesAtIndex:(NSUInteger)index effectiveRange:(NSRangePointer)outRange
+{
+	NSUInteger runStart;
+	const RMSTextNode *run = RMSTextNodeFind(attributeRoot, index, &runStart);
+	
+	if (run == NULL) [NSException raise:NSRangeException format:@"%@: index %lu is out of bounds", NSStringFromSelector(_cmd), (unsigned long)index];
+	if (outRange) *outRange = NSMakeRange(runStart, run->length);
+	
+	return run->object;
+}
+
+- (void)replaceAttributesInRange:(NSRange)range withAttributes:(NSDictionary *)attributes length:(NSUInteger)length
+{
+	NSUInteger totalLength = RMSTextNodeTotalLength(attributeRoot);
+	NSUInteger runStart;
+	
+	const RMSTextNode *runBefore = (range.location > 0) ? RMSTextNodeFind(attributeRoot, range.location - 1, &runStart) : NULL;
+	NSUInteger runBeforeStart = runStart;
+	
+	const RMSTextNode *runAfter = (NSMaxRange(range) < totalLength) ? RMSTextNodeFind(attributeRoot, NSMaxRange(range), &runStart) : NULL;
+	NSUInteger runAfterEnd = (runAfter) ? runStart + runAfter->length : 0;
+	
+	// A deletion can bring two equal runs together; otherwise there's no new run to join to anything.
+	if (length == 0)
+	{
+		if (runBefore == NULL || runAfter == NULL || (runBefore->object != runAfter->object && [runBefore->object isEqualToDictionary:runAfter->object] == NO)) runBefore = runAfter = NULL;
+		else attributes = runBefore->object;
+	}
+	
+	if (attributes == nil) attributes = [NSDictionary dictionary];
+	
+	// Runs with equal attributes are joined into one, so typing doesn't leave a run per character.
+	if (runBefore && (runBefore->object == attributes || [runBefore->object isEqualToDictionary:attributes]))
+	{
+		attributes = runBefore->object;
+		length += range.location - runBeforeStart;
+		range = NSMakeRange(runBeforeStart, NSMaxRange(range) - runBeforeStart);
+	}
+	
+	if (runAfter && (runAfter->object == attributes || [runAfter->object isEqualToDictionary:attributes]))
+	{
+		length += runAfterEnd - NSMaxRange(range);
+		range.length = runAfterEnd - range.location;
+	}
+	
+	RMSTextNode *oldAttributeRoot = attributeRoot;
+	
+	attributeRoot = RMSTextNodeReplace(oldAttributeRoot, range, [self newRunWithAttributes:attributes length:length]);
+	RMSTextNodeRelease(oldAttributeRoot);
+}
+
+- (void)replaceCharactersInRange:(NSRange)range withString:(NSString *)aString
+{
+	NSUInteger length = RMSTextNodeTotalLength(textRoot);
+	if (NSMaxRange(range) > length) [NSException raise:NSRangeException format:@"%@: range %@ is out of bounds", NSStringFromSelector(_cmd), NSStringFromRange(range)];
+	
+	// New text takes the attributes of the first character it replaces, or else of the one before it.
+	NSDictionary *attributes = nil;
+	
+	if (length > 0)
+	{
+		NSUInteger attributesIndex = (range.length > 0 || range.location == 0) ? range.location : range.location - 1;
+		attributes = [self attributesAtIndex:MIN(attributesIndex, length - 1) effectiveRange:NULL];
+	}
+	
+	RMSTextNode *piece = [self newPieceWithString:aString];
+	NSRange replacedRange = range;
+	
+	if (piece && piece->characters && range.location > 0)
+	{
+		NSUInteger previousStart;
+		const RMSTextNode *previous = RMSTextNodeFind(textRoot, range.location - 1, &previousStart);
+		
+		// Typing appends to the buffer right after the characters just typed, so the piece before simply grows instead of a new piece being added.
+		if (previousStart + previous->length == range.location && previous->object == piece->object && previous->characters + previous->length == piece->characters)
+		{
+			RMSTextNode *extendedPiece = RMSTextNodeCreate(previous, 0, previous->length + piece->length, [self nextPriority], NULL, NULL);
+			
+			RMSTextNodeRelease(piece);
+			piece = extendedPiece;
+			replacedRange = NSMakeRange(previousStart, NSMaxRange(range) - previousStart);
+		}
+	}
+	
+	RMSTextNode *oldTextRoot = textRoot;
+	
+	textRoot = RMSTextNodeReplace(oldTextRoot, replacedRange, piece);
+	RMSTextNodeRelease(oldTextRoot);
+	
+	[self replaceAttributesInRange:range withAttributes:attributes length:[aString length]];
+	editCount++;
+	
+	[self edited:NSTextStorageEditedCharacters range:range changeInLength:((NSInteger)[aString length] - (NSInteger)range.length)];
+}
+
+- (void)setAttributes:(NSDictionary *)attributes range:(NSRange)range
+{
+	if (NSMaxRange(range) > RMSTextNodeTotalLength(attributeRoot)) [NSException raise:NSRangeException format:@"%@: range %@ is out of bounds", NSStringFromSelector(_cmd), NSStringFromRange(range)];
+	if (range.length == 0) return;
+	
+	NSDictionary *attributesCopy = [attributes copy];
+	[self replaceAttributesInRange:range withAttributes:attributesCopy length:range.length];
+	[attributesCopy release];
+	
+	[self edited:NSTextStorageEditedAttributes range:range changeInLength:0];
+}
+
+//***************************************************************************
+
+#pragma mark Object Lifecycle
+
+- (id)init
+{
+	self = [super init];
+	
+	if (self)
+	{
+		prioritySeed = 2463534242U;
+		string = [[RMSPieceTableString alloc] initWithTextStorage:self];
+	}
+	
+	return self;
+}
+
+- (id)initWithString:(NSString *)aString attributes:(NSDictionary *)attributes
+{
+	self = [self init];
+	
+	if (self)
+	{
+		textRoot = [self newPieceWithString:aString];
+		attributeRoot = [self newRunWithAttributes:attributes length:[aString length]];
+	}
+	
+	return self;
+}
+
+- (id)initWithString:(NSString *)aString
+{
+	return [self initWithString:aString attributes:nil];
+}
+
+- (id)initWithAttributedString:(NSAttributedString *)attributedString
+{
+	self = [self init];
+	
+	if (self)
+	{
+		[self setAttributedString:attributedString];
+	}
+	
+	return self;
+}
+
+- (void)dealloc
+{
+	[string detachFromTextStorage];
+	
+	RMSTextNodeRelease(textRoot);
+	RMSTextNodeRelease(attributeRoot);
+	
+	[appendBuffer release];
+	[string release];
+	[snapshot release];
+	
+	[super dealloc];
+}
+
+@end
+
+//***************************************************************************
@@ -0,0 +1,35 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+// A bounded, lock-free queue of fixed-size records between exactly one
+// producer thread and exactly one consumer thread.  Each side only ever
+// writes its own index, and memory barriers order the record copies
+// against the index updates, so neither side takes a lock or makes a
+// system call.  Neither side blocks either: pushing to a full queue or
+// popping from an empty one just returns NO, and it's up to the caller
+// whether to back off and retry.
+
+//***************************************************************************
+
+typedef struct RMSSPSCQueue RMSSPSCQueue;
+
+/// The capacity is rounded up to a power of two.
+RMSSPSCQueue *RMSSPSCQueueCreate(uint32_t capacity, size_t recordSize);
+void RMSSPSCQueueDestroy(RMSSPSCQueue *queue);
+
+/// Producer side only.
+BOOL RMSSPSCQueuePush(RMSSPSCQueue *queue, const void *record);
+
+/// Consumer side only.
+BOOL RMSSPSCQueuePop(RMSSPSCQueue *queue, void *record);
+
+//***************************************************************************
@@ -0,0 +1,101 @@
+//***************************************************************************
+
+// Copyright (C) 2010 Realmac Software Ltd
+//
+// These coded instructions, statements, and computer programs contain
+// unpublished proprietary information of Realmac Software Ltd
+// and are protected by copyright law. They may not be disclosed
+// to third parties or copied or duplicated in any form, in whole or
+// in part, without the prior written consent of Realmac Software Ltd.
+
+//***************************************************************************
+
+#include <libkern/OSAtomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#import "RMSSPSCQueue.h"
+
+//***************************************************************************
+
+struct RMSSPSCQueue
+{
+	char *records;
+	size_t recordSize;
+	uint32_t mask;
+	
+	// The indices only ever increase, wrapping at 2^32, so head == tail means empty and tail - head == capacity means full.
+	// They're kept on separate cache lines so the two threads don't keep stealing one line from each other.
+	char headPadding[64];
+	volatile uint32_t head;
+	char tailPadding[64];
+	volatile uint32_t tail;
+};
+
+//***************************************************************************
+
+RMSSPSCQueue *RMSSPSCQueueCreate(uint32_t capacity, size_t recordSize)
+{
+	uint32_t roundedCapacity = 1;
+	while (roundedCapacity < capacity) roundedCapacity <<= 1;
+	
+	RMSSPSCQueue *queue = calloc(1, sizeof(RMSSPSCQueue));
+	if (queue == NULL) return NULL;
+	
+	queue->records = malloc((size_t)roundedCapacity * recordSize);
+	
+	if (queue->records == NULL)
+	{
+		free(queue);
+		return NULL;
+	}
+	
+	queue->recordSize = recordSize;
+	queue->mask = roundedCapacity - 1;
+	
+	return queue;
+}
+
+void RMSSPSCQueueDestroy(RMSSPSCQueue *queue)
+{
+	if (queue == NULL) return;
+	
+	free(queue->records);
+	free(queue);
+}
+
+BOOL RMSSPSCQueuePush(RMSSPSCQueue *queue, const void *record)
+{
+	uint32_t tail = queue->tail;
+	uint32_t head = queue->head;
+	
+	if (tail - head > queue->mask) return NO;
+	
+	memcpy(queue->records + (size_t)(tail & queue->mask) * queue->recordSize, record, queue->recordSize);
+	
+	// The record has to be visible before the consumer can see the new tail.
+	OSMemoryBarrier();
+	queue->tail = tail + 1;
+	
+	return YES;
+}
+
+BOOL RMSSPSCQueuePop(RMSSPSCQueue *queue, void *record)
+{
+	uint32_t head = queue->head;
+	uint32_t tail = queue->tail;
+	
+	if (head == tail) return NO;
+	
+	// Don't read the record before the tail that published it.
+	OSMemoryBarrier();
+	memcpy(record, queue->records + (size_t)(head & queue->mask) * queue->recordSize, queue->recordSize);
+	
+	// Finish reading the slot before handing it back to the producer.
+	OSMemoryBarrier();
+	queue->head = head + 1;
+	
+	return YES;
+}
+
+//***************************************************************************
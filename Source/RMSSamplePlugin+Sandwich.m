@@ -11,7 +11,7 @@
 //***************************************************************************
 
 #import "RMSSamplePlugin+Sandwich.h"
-#import "RMSSamplePluginContentViewController.h"
+#import "RMSChangeBus.h"
 
 //***************************************************************************
 
@@ -47,6 +47,9 @@
 
 - (RMSandwich *)sandwich
 {
+	// As in -encodeWithCoder:, the last edits are broadcast before they're written out, not after.
+	[changeBus flush];
+	
 	RMSandwich *sandwich = [RMSandwich sandwichWithType:@"RapidWeaver HTML Code Data"];
 	
 	NSDictionary *dictionary = [NSDictionary dictionaryWithObjectsAndKeys:
@@ -55,7 +58,7 @@
 	
 	NSString *pathToHTMLContents = [[NSFileManager defaultManager] temporaryFilenameWithPrefix:@"HTMLPageSave" extension:@"html"];
 	
-	NSString *html = (contentViewController.content) ?: self.content;
+	NSString *html = [self flattenedContent];
 	[html writeToFile:pathToHTMLContents atomically:NO encoding:NSUTF8StringEncoding error:NULL];
 	
 	NSDictionary *files = [NSDictionary dictionaryWithObjectsAndKeys:pathToHTMLContents, @"Contents.html", nil];
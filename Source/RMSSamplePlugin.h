@@ -12,6 +12,7 @@
 
 @class RMSSamplePluginOptionsViewController;
 @class RMSSamplePluginContentViewController;
+@class RMSChangeBus;
 
 //***************************************************************************
 
@@ -22,13 +23,23 @@
 	
 	RMSSamplePluginContentViewController *contentViewController;
 	RMSSamplePluginOptionsViewController *optionsViewController;
+	
+	RMSChangeBus *changeBus;
 }
 
 @property (nonatomic, copy) NSString *content;
 @property (nonatomic, assign) BOOL emitRawContent;
 
+/// Every change to the page goes through here, to be broadcast in batches rather than one at a time.
+@property (nonatomic, readonly) RMSChangeBus *changeBus;
+
 + (NSBundle *)bundle;
 
+/// The page's text as a plain string, for saving and exporting.
+/** While the page is being edited this is the editor's snapshot, which is
+  * immutable and safe to keep; it isn't copied. */
+- (NSString *)flattenedContent;
+
 @end
 
 //***************************************************************************
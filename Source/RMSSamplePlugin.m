@@ -13,6 +13,7 @@
 #import "RMSSamplePlugin.h"
 #import "RMSSamplePluginOptionsViewController.h"
 #import "RMSSamplePluginContentViewController.h"
+#import "RMSChangeBus.h"
 
 //***************************************************************************
 
@@ -20,7 +21,7 @@
 
 static NSBundle *sPluginBundle = nil;
 
-@synthesize content, emitRawContent;
+@synthesize content, emitRawContent, changeBus;
 
 //***************************************************************************
 
@@ -48,12 +49,13 @@ static NSBundle *sPluginBundle = nil;
 
 - (id)contentHTML:(NSDictionary *)params
 {
-	NSString *string = (contentViewController.content) ?: self.content;
+	// Only the string is reused between exports; the subpage is made afresh each time, since RWKit hands back a mutable dictionary the exporter is free to change.
+	NSString *string = [self flattenedContent];
 	
 	id result;
 	
-	if (self.emitRawContent == NO) result = [NSString stringWithString:string];
-	else result = [self contentOnlySubpageWithEntireHTML:[NSString stringWithString:string] name:nil];
+	if (self.emitRawContent == NO) result = string;
+	else result = [self contentOnlySubpageWithEntireHTML:string name:nil];
 	
 	return result;
 }
@@ -77,6 +79,18 @@ static NSBundle *sPluginBundle = nil;
 
 //***************************************************************************
 
+#pragma mark Content
+
+- (NSString *)flattenedContent
+{
+	// The editor's snapshot is immutable and stays the same object until the next edit, so it's handed on as it is.
+	NSString *snapshot = contentViewController.content;
+	
+	return (snapshot) ?: self.content;
+}
+
+//***************************************************************************
+
 #pragma mark KVO Broadcasting
 
 - (NSArray *)visibleKeys
@@ -92,7 +106,7 @@ static NSBundle *sPluginBundle = nil;
 {
 	if ([[self visibleKeys] containsObject:keyPath])
 	{
-		[self broadcastPluginChanged];
+		[changeBus noteChangeForKey:keyPath];
 	}
 }
 
@@ -125,14 +139,19 @@ static NSBundle *sPluginBundle = nil;
 	contentViewController = nil;
 	optionsViewController = nil;
 	
+	changeBus = [[RMSChangeBus alloc] initWithTarget:self action:@selector(broadcastPluginChanged)];
+	
 	[self observeVisibleKeys];
 }
 
 - (void)encodeWithCoder:(NSCoder *)aCoder
 {
+	// Anything still waiting to be broadcast is sent first, so the document doesn't hear about it after it's been saved.
+	[changeBus flush];
+	
 	[super encodeWithCoder:aCoder];
 	
-	[aCoder encodeObject:(contentViewController.content) ?: self.content forKey:@"Content String"];
+	[aCoder encodeObject:[self flattenedContent] forKey:@"Content String"];
 	[aCoder encodeObject:[NSNumber numberWithBool:self.emitRawContent] forKey:@"Emit Raw Content"];
 }
 
@@ -164,11 +183,14 @@ static NSBundle *sPluginBundle = nil;
 {
 	[self stopObservingVisibleKeys];
 	
+	[changeBus invalidate];
+	[changeBus release];
+	
 	self.content = nil;
 	
 	[contentViewController release];
 	[optionsViewController release];
-	
+
     [super dealloc];
 }
 
@@ -10,11 +10,21 @@
 
 //***************************************************************************
 
+@class RMSHTMLView;
+@class RMSHTMLHighlighter;
+@class RMSLineNumberRulerView;
+
+//***************************************************************************
+
 @interface RMSSamplePluginContentViewController : NSViewController
 {
-	IBOutlet RWHTMLView *htmlView;
+	IBOutlet RMSHTMLView *htmlView;
+	
+	RMSHTMLHighlighter *highlighter;
+	RMSLineNumberRulerView *lineNumberView;
 }
 
+/// An immutable snapshot of the text, which is the same object until the text is next edited.
 @property (nonatomic, readonly) NSString *content;
 
 - (id)initWithRepresentedObject:(id)inObject;
@@ -12,6 +12,11 @@
 
 #import "RMSSamplePlugin.h"
 #import "RMSSamplePluginContentViewController.h"
+#import "RMSHTMLView.h"
+#import "RMSHTMLHighlighter.h"
+#import "RMSLineNumberRulerView.h"
+#import "RMSPieceTableTextStorage.h"
+#import "RMSChangeBus.h"
 
 //***************************************************************************
 
@@ -21,14 +26,29 @@
 
 - (NSString *)content
 {
-	return [htmlView string];
+	NSTextStorage *textStorage = [htmlView textStorage];
+	
+	if ([textStorage isKindOfClass:[RMSPieceTableTextStorage class]])
+	{
+		return [(RMSPieceTableTextStorage *)textStorage snapshotString];
+	}
+	
+	return [[[htmlView string] copy] autorelease];
 }
 
-- (void)textDidChange:(NSNotification *)aNotification
+- (void)textStorageDidProcessEditing:(NSNotification *)notification
 {
-	RMSSamplePlugin *p = self.representedObject;
+	NSTextStorage *textStorage = [notification object];
 	
-	[p broadcastPluginChanged];
+	// Attribute changes, like the highlighter's colouring, aren't edits to the page.
+	if (([textStorage editedMask] & NSTextStorageEditedCharacters) == 0) return;
+	
+	// Seen after the edit, so this catches programmatic changes as well as typing, and the lengths are the ones that actually went in.
+	NSRange editedRange = [textStorage editedRange];
+	NSRange replacedRange = NSMakeRange(editedRange.location, editedRange.length - [textStorage changeInLength]);
+	
+	RMSSamplePlugin *p = self.representedObject;
+	[p.changeBus noteChangeForKey:@"content" replacingRange:replacedRange withLength:editedRange.length];
 }
 
 - (void)awakeFromNib
@@ -36,11 +56,31 @@
 	RMSSamplePlugin *p = self.representedObject;
 	NSString *string = p.content;
 	
+	// Edits to large pages don't move the text after them, and copying the text for the background lexer is free.
+	RMSPieceTableTextStorage *textStorage = [[RMSPieceTableTextStorage alloc] init];
+	[[htmlView layoutManager] replaceTextStorage:textStorage];
+	[textStorage release];
+	
 	if (string)
 	{
 		[htmlView setString:string lazily:YES];
-		[htmlView colorize];
 	}
+	
+	// Watched only once the saved text is in, so loading it isn't taken for an edit.
+	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(textStorageDidProcessEditing:) name:NSTextStorageDidProcessEditingNotification object:[htmlView textStorage]];
+	
+	// The nib's RMSHTMLView never runs -colorize, so this is the only thing colouring the text.
+	highlighter = [[RMSHTMLHighlighter alloc] initWithTextView:htmlView];
+	
+	// RWHTMLView's own gutter recounts every line on each change; this one shares the highlighter's line index.
+	[htmlView setShowLineNumbers:NO];
+	
+	NSScrollView *scrollView = [htmlView enclosingScrollView];
+	lineNumberView = [[RMSLineNumberRulerView alloc] initWithTextView:htmlView lineIndex:[highlighter lineIndex]];
+	
+	[scrollView setVerticalRulerView:lineNumberView];
+	[scrollView setHasVerticalRuler:YES];
+	[scrollView setRulersVisible:YES];
 }
 
 - (id)initWithRepresentedObject:(id)inObject
@@ -55,6 +95,19 @@
 	return self;
 }
 
+- (void)dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	
+	[lineNumberView invalidate];
+	[lineNumberView release];
+	
+	[highlighter invalidate];
+	[highlighter release];
+	
+	[super dealloc];
+}
+
 @end
 
 //***************************************************************************